@@ -1,3 +1,886 @@
 
 #include "ImageResize.h"
+#include "simd.h"
 
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <memory.h>
+
+//=== scalar kernels, the loops of the original two pass filter
+
+static inline uint32_t normalize(float intensityR, float intensityG, float intensityB, float wsum) {
+   intensityR /= wsum;
+   intensityG /= wsum;
+   intensityB /= wsum;
+   if(intensityR < 0) intensityR = 0;
+   if(intensityR > 255) intensityR = 255;
+   if(intensityG < 0) intensityG = 0;
+   if(intensityG > 255) intensityG = 255;
+   if(intensityB < 0) intensityB = 0;
+   if(intensityB > 255) intensityB = 255;
+   return (((int)intensityR)<<16) | (((int)intensityG)<<8) | ((int)intensityB);
+}
+
+static void filterRowScalar(const uint32_t *input, const ImageResize::ContributorEntry *contributors,
+                            uint32_t *output, int outputSize) {
+   for(int i=0; i<outputSize; ++i) {
+      float intensityR = 0;
+      float intensityG = 0;
+      float intensityB = 0;
+      for(int j=0; j<contributors[i].number; ++j) {
+         float weight = contributors[i].p[j].weight;
+         uint32_t sourcePixel = input[contributors[i].p[j].pixelOffset];
+         intensityR += ((sourcePixel&0x00ff0000) >> 16) * weight;
+         intensityG += ((sourcePixel&0x0000ff00) >> 8) * weight;
+         intensityB +=  (sourcePixel&0x000000ff) * weight;
+      }
+      output[i] = normalize(intensityR, intensityG, intensityB, contributors[i].wsum);
+   }
+}
+
+static void filterColumnsScalar(const uint32_t *work, ptrdiff_t workPitch, const ImageResize::ContributorEntry &entry,
+                                uint32_t *output, int width) {
+   for(int k=0; k<width; ++k) {
+      float intensityR = 0;
+      float intensityG = 0;
+      float intensityB = 0;
+      for(int j=0; j<entry.number; ++j) {
+         float weight = entry.p[j].weight;
+         uint32_t sourcePixel = work[entry.p[j].pixelOffset*workPitch + k];
+         intensityR += ((sourcePixel&0x00ff0000) >> 16) * weight;
+         intensityG += ((sourcePixel&0x0000ff00) >> 8) * weight;
+         intensityB +=  (sourcePixel&0x000000ff) * weight;
+      }
+      output[k] = normalize(intensityR, intensityG, intensityB, entry.wsum);
+   }
+}
+
+//=== scalar kernels of the linear light resample, fixed point on 16 bit lanes [b, g, r, a]
+
+//the shifts from the sums of a pass back to its lanes and the biggest lane values
+enum {
+   HorizontalShift = ImageResize::FixedBits + ImageResize::LinearBits - ImageResize::LinearWorkBits,
+   VerticalShift = ImageResize::FixedBits + ImageResize::LinearWorkBits - ImageResize::LinearBits,
+   MaximumLinear = (1 << ImageResize::LinearBits) - 1,
+   MaximumWork = MaximumLinear << (ImageResize::LinearWorkBits - ImageResize::LinearBits)
+};
+
+//rounds, shifts and clamps like the vector kernels do with srai, packs, max and min
+static inline int toLane(int sum, int shift, int maximum) {
+   int value = (sum + (1 << (shift-1))) >> shift;
+   return (value < 0) ? 0 : ((value > maximum) ? maximum : value);
+}
+
+static void filterRowLinearScalar(const uint16_t *input, const ImageResize::FixedContributorEntry *contributors,
+                                  uint16_t *output, int outputSize) {
+   for(int i=0; i<outputSize; ++i) {
+      int sumB = 0;
+      int sumG = 0;
+      int sumR = 0;
+      for(int j=0; j<contributors[i].number; ++j) {
+         int weight = contributors[i].p[j].weight;
+         const uint16_t *pixel = &input[contributors[i].p[j].pixelOffset*4];
+         sumB += pixel[0]*weight;
+         sumG += pixel[1]*weight;
+         sumR += pixel[2]*weight;
+      }
+      output[i*4] = (uint16_t)toLane(sumB, HorizontalShift, MaximumWork);
+      output[i*4+1] = (uint16_t)toLane(sumG, HorizontalShift, MaximumWork);
+      output[i*4+2] = (uint16_t)toLane(sumR, HorizontalShift, MaximumWork);
+      output[i*4+3] = 0;
+   }
+}
+
+static void filterColumnsLinearScalar(const uint16_t *work, ptrdiff_t workPitch,
+                                      const ImageResize::FixedContributorEntry &entry, uint32_t *output, int width) {
+   const uint8_t *toSRGB = ImageResize::getSRGBTable();
+   for(int k=0; k<width; ++k) {
+      int sumB = 0;
+      int sumG = 0;
+      int sumR = 0;
+      for(int j=0; j<entry.number; ++j) {
+         int weight = entry.p[j].weight;
+         const uint16_t *pixel = &work[(entry.p[j].pixelOffset*workPitch + k)*4];
+         sumB += pixel[0]*weight;
+         sumG += pixel[1]*weight;
+         sumR += pixel[2]*weight;
+      }
+      output[k] = ((uint32_t)toSRGB[toLane(sumR, VerticalShift, MaximumLinear)] << 16) |
+                  ((uint32_t)toSRGB[toLane(sumG, VerticalShift, MaximumLinear)] << 8) |
+                  toSRGB[toLane(sumB, VerticalShift, MaximumLinear)];
+   }
+}
+
+#ifdef IMAGEUTILS_SSE2
+//=== sse2: the channels of a pixel are the four float lanes [b, g, r, a] of one register
+
+static inline __m128 pixelToFloats(uint32_t pixel) {
+   __m128i zero = _mm_setzero_si128();
+   __m128i bytes = _mm_cvtsi32_si128((int)pixel);
+   return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+//divide, clamp, truncate. the alpha lane is computed as well and cleared at the end
+static inline __m128i normalizeSSE2(__m128 intensity, __m128 wsum) {
+   intensity = _mm_div_ps(intensity, wsum);
+   intensity = _mm_max_ps(intensity, _mm_setzero_ps());
+   intensity = _mm_min_ps(intensity, _mm_set1_ps(255.0f));
+   return _mm_cvttps_epi32(intensity);
+}
+
+//four pixels of 32 bit lanes to four packed pixels
+static inline __m128i packPixels(__m128i p0, __m128i p1, __m128i p2, __m128i p3) {
+   __m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+   return _mm_and_si128(packed, _mm_set1_epi32(0x00ffffff));
+}
+
+static inline uint32_t packPixel(__m128i p) {
+   p = _mm_packs_epi32(p, p);
+   return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(p, p)) & 0x00ffffff;
+}
+
+static void filterRowSSE2(const uint32_t *input, const ImageResize::ContributorEntry *contributors,
+                          uint32_t *output, int outputSize) {
+   for(int i=0; i<outputSize; ++i) {
+      const ImageResize::ContributorEntry &entry = contributors[i];
+      __m128 intensity = _mm_setzero_ps();
+      for(int j=0; j<entry.number; ++j) {
+         __m128 weight = _mm_set1_ps(entry.p[j].weight);
+         intensity = _mm_add_ps(intensity, _mm_mul_ps(pixelToFloats(input[entry.p[j].pixelOffset]), weight));
+      }
+      output[i] = packPixel(normalizeSSE2(intensity, _mm_set1_ps(entry.wsum)));
+   }
+}
+
+static void filterColumnsSSE2(const uint32_t *work, ptrdiff_t workPitch, const ImageResize::ContributorEntry &entry,
+                              uint32_t *output, int width) {
+   __m128i zero = _mm_setzero_si128();
+   __m128 wsum = _mm_set1_ps(entry.wsum);
+   int k = 0;
+   for(; k+4<=width; k+=4) {
+      __m128 intensity0 = _mm_setzero_ps();
+      __m128 intensity1 = _mm_setzero_ps();
+      __m128 intensity2 = _mm_setzero_ps();
+      __m128 intensity3 = _mm_setzero_ps();
+      for(int j=0; j<entry.number; ++j) {
+         __m128 weight = _mm_set1_ps(entry.p[j].weight);
+         __m128i pixels = _mm_loadu_si128((const __m128i*)&work[entry.p[j].pixelOffset*workPitch + k]);
+         __m128i low = _mm_unpacklo_epi8(pixels, zero);
+         __m128i high = _mm_unpackhi_epi8(pixels, zero);
+         intensity0 = _mm_add_ps(intensity0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), weight));
+         intensity1 = _mm_add_ps(intensity1, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), weight));
+         intensity2 = _mm_add_ps(intensity2, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), weight));
+         intensity3 = _mm_add_ps(intensity3, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), weight));
+      }
+      _mm_storeu_si128((__m128i*)&output[k], packPixels(normalizeSSE2(intensity0, wsum), normalizeSSE2(intensity1, wsum),
+                                                        normalizeSSE2(intensity2, wsum), normalizeSSE2(intensity3, wsum)));
+   }
+   for(; k<width; ++k) {
+      __m128 intensity = _mm_setzero_ps();
+      for(int j=0; j<entry.number; ++j) {
+         __m128 weight = _mm_set1_ps(entry.p[j].weight);
+         intensity = _mm_add_ps(intensity, _mm_mul_ps(pixelToFloats(work[entry.p[j].pixelOffset*workPitch + k]), weight));
+      }
+      output[k] = packPixel(normalizeSSE2(intensity, wsum));
+   }
+}
+//=== sse2 linear light: pmaddwd on the lanes of two taps interleaved, with both weights in every
+//32 bit lane of the other operand. a missing second tap gets a zero weight
+
+static inline __m128i tapWeights(int weight0, int weight1) {
+   return _mm_set1_epi32((int)(((uint32_t)weight1 << 16) | ((uint32_t)weight0 & 0xffff)));
+}
+
+static inline uint32_t lanesToPixel(const uint8_t *toSRGB, const uint16_t *lanes) {
+   return ((uint32_t)toSRGB[lanes[2]] << 16) | ((uint32_t)toSRGB[lanes[1]] << 8) | toSRGB[lanes[0]];
+}
+
+static void filterRowLinearSSE2(const uint16_t *input, const ImageResize::FixedContributorEntry *contributors,
+                                uint16_t *output, int outputSize) {
+   __m128i zero = _mm_setzero_si128();
+   __m128i round = _mm_set1_epi32(1 << (HorizontalShift-1));
+   __m128i maximum = _mm_set1_epi16(MaximumWork);
+   for(int i=0; i<outputSize; ++i) {
+      const ImageResize::FixedContributorEntry &entry = contributors[i];
+      __m128i sum = _mm_setzero_si128();
+      int j = 0;
+      for(; j+2<=entry.number; j+=2) {
+         __m128i pixel0 = _mm_loadl_epi64((const __m128i*)&input[entry.p[j].pixelOffset*4]);
+         __m128i pixel1 = _mm_loadl_epi64((const __m128i*)&input[entry.p[j+1].pixelOffset*4]);
+         __m128i weights = tapWeights(entry.p[j].weight, entry.p[j+1].weight);
+         sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(pixel0, pixel1), weights));
+      }
+      if(j < entry.number) {
+         __m128i pixel0 = _mm_loadl_epi64((const __m128i*)&input[entry.p[j].pixelOffset*4]);
+         sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(pixel0, zero), tapWeights(entry.p[j].weight, 0)));
+      }
+      __m128i lanes = _mm_srai_epi32(_mm_add_epi32(sum, round), HorizontalShift);
+      lanes = _mm_packs_epi32(lanes, lanes);
+      lanes = _mm_min_epi16(_mm_max_epi16(lanes, zero), maximum);
+      _mm_storel_epi64((__m128i*)&output[i*4], lanes);
+   }
+}
+
+static void filterColumnsLinearSSE2(const uint16_t *work, ptrdiff_t workPitch,
+                                    const ImageResize::FixedContributorEntry &entry, uint32_t *output, int width) {
+   const uint8_t *toSRGB = ImageResize::getSRGBTable();
+   __m128i zero = _mm_setzero_si128();
+   __m128i round = _mm_set1_epi32(1 << (VerticalShift-1));
+   __m128i maximum = _mm_set1_epi16(MaximumLinear);
+   uint16_t lanes[8];
+   int k = 0;
+   for(; k+2<=width; k+=2) {
+      __m128i sum0 = _mm_setzero_si128();
+      __m128i sum1 = _mm_setzero_si128();
+      int j = 0;
+      for(; j+2<=entry.number; j+=2) {
+         __m128i row0 = _mm_loadu_si128((const __m128i*)&work[(entry.p[j].pixelOffset*workPitch + k)*4]);
+         __m128i row1 = _mm_loadu_si128((const __m128i*)&work[(entry.p[j+1].pixelOffset*workPitch + k)*4]);
+         __m128i weights = tapWeights(entry.p[j].weight, entry.p[j+1].weight);
+         sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(row0, row1), weights));
+         sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(row0, row1), weights));
+      }
+      if(j < entry.number) {
+         __m128i row0 = _mm_loadu_si128((const __m128i*)&work[(entry.p[j].pixelOffset*workPitch + k)*4]);
+         __m128i weights = tapWeights(entry.p[j].weight, 0);
+         sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(row0, zero), weights));
+         sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(row0, zero), weights));
+      }
+      __m128i packed = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(sum0, round), VerticalShift),
+                                       _mm_srai_epi32(_mm_add_epi32(sum1, round), VerticalShift));
+      _mm_storeu_si128((__m128i*)lanes, _mm_min_epi16(_mm_max_epi16(packed, zero), maximum));
+      output[k] = lanesToPixel(toSRGB, lanes);
+      output[k+1] = lanesToPixel(toSRGB, lanes+4);
+   }
+   if(k < width)
+      filterColumnsLinearScalar(work+k*4, workPitch, entry, output+k, width-k);
+}
+#endif
+
+#ifdef IMAGEUTILS_AVX2
+//=== avx2: two pixels per register, [b, g, r, a] in each 128 bit half
+
+IMAGEUTILS_TARGET_AVX2 static inline __m256 pixelsToFloats(uint64_t twoPixels) {
+   return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long)twoPixels)));
+}
+
+IMAGEUTILS_TARGET_AVX2 static inline __m256i normalizeAVX2(__m256 intensity, __m256 wsum) {
+   intensity = _mm256_div_ps(intensity, wsum);
+   intensity = _mm256_max_ps(intensity, _mm256_setzero_ps());
+   intensity = _mm256_min_ps(intensity, _mm256_set1_ps(255.0f));
+   return _mm256_cvttps_epi32(intensity);
+}
+
+//eight pixels in four registers to eight packed pixels, packs work within the 128 bit halves
+IMAGEUTILS_TARGET_AVX2 static inline __m256i packPixelsAVX2(__m256i p01, __m256i p23, __m256i p45, __m256i p67) {
+   __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+   //the halves hold pixels 0 2 4 6 and 1 3 5 7
+   packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+   return _mm256_and_si256(packed, _mm256_set1_epi32(0x00ffffff));
+}
+
+IMAGEUTILS_TARGET_AVX2 static void filterRowAVX2(const uint32_t *input, const ImageResize::ContributorEntry *contributors,
+                                                 uint32_t *output, int outputSize) {
+   int i = 0;
+   for(; i+2<=outputSize; i+=2) {
+      //two output pixels share the taps both of them have, the longer one finishes alone
+      const ImageResize::ContributorEntry &first = contributors[i];
+      const ImageResize::ContributorEntry &second = contributors[i+1];
+      int common = eastl::min(first.number, second.number);
+      __m256 intensity = _mm256_setzero_ps();
+      int j = 0;
+      for(; j<common; ++j) {
+         uint64_t twoPixels = (uint64_t)input[first.p[j].pixelOffset] | ((uint64_t)input[second.p[j].pixelOffset] << 32);
+         __m256 weight = _mm256_setr_m128(_mm_set1_ps(first.p[j].weight), _mm_set1_ps(second.p[j].weight));
+         intensity = _mm256_add_ps(intensity, _mm256_mul_ps(pixelsToFloats(twoPixels), weight));
+      }
+      __m128 intensityFirst = _mm256_castps256_ps128(intensity);
+      __m128 intensitySecond = _mm256_extractf128_ps(intensity, 1);
+      for(int jj=j; jj<first.number; ++jj)
+         intensityFirst = _mm_add_ps(intensityFirst, _mm_mul_ps(pixelToFloats(input[first.p[jj].pixelOffset]),
+                                                                _mm_set1_ps(first.p[jj].weight)));
+      for(int jj=j; jj<second.number; ++jj)
+         intensitySecond = _mm_add_ps(intensitySecond, _mm_mul_ps(pixelToFloats(input[second.p[jj].pixelOffset]),
+                                                                  _mm_set1_ps(second.p[jj].weight)));
+      __m256i result = normalizeAVX2(_mm256_setr_m128(intensityFirst, intensitySecond),
+                                     _mm256_setr_m128(_mm_set1_ps(first.wsum), _mm_set1_ps(second.wsum)));
+      output[i] = packPixel(_mm256_castsi256_si128(result));
+      output[i+1] = packPixel(_mm256_extracti128_si256(result, 1));
+   }
+   if(i < outputSize)
+      filterRowSSE2(input, contributors+i, output+i, outputSize-i);
+}
+
+IMAGEUTILS_TARGET_AVX2 static void filterColumnsAVX2(const uint32_t *work, ptrdiff_t workPitch,
+                                                     const ImageResize::ContributorEntry &entry,
+                                                     uint32_t *output, int width) {
+   __m256 wsum = _mm256_set1_ps(entry.wsum);
+   int k = 0;
+   for(; k+8<=width; k+=8) {
+      __m256 intensity01 = _mm256_setzero_ps();
+      __m256 intensity23 = _mm256_setzero_ps();
+      __m256 intensity45 = _mm256_setzero_ps();
+      __m256 intensity67 = _mm256_setzero_ps();
+      for(int j=0; j<entry.number; ++j) {
+         __m256 weight = _mm256_set1_ps(entry.p[j].weight);
+         __m256i pixels = _mm256_loadu_si256((const __m256i*)&work[entry.p[j].pixelOffset*workPitch + k]);
+         __m128i low = _mm256_castsi256_si128(pixels);
+         __m128i high = _mm256_extracti128_si256(pixels, 1);
+         intensity01 = _mm256_add_ps(intensity01, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(low)), weight));
+         intensity23 = _mm256_add_ps(intensity23, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(low, 8))), weight));
+         intensity45 = _mm256_add_ps(intensity45, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(high)), weight));
+         intensity67 = _mm256_add_ps(intensity67, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(high, 8))), weight));
+      }
+      _mm256_storeu_si256((__m256i*)&output[k], packPixelsAVX2(normalizeAVX2(intensity01, wsum), normalizeAVX2(intensity23, wsum),
+                                                               normalizeAVX2(intensity45, wsum), normalizeAVX2(intensity67, wsum)));
+   }
+   if(k < width)
+      filterColumnsSSE2(work+k, workPitch, entry, output+k, width-k);
+}
+//four pixels per register, two registers per row. pixels 0 and 2 come out of the low and 1 and 3
+//out of the high unpack, packing the sums puts them back in order
+IMAGEUTILS_TARGET_AVX2 static inline __m256i linearLanesAVX2(__m256i sum02, __m256i sum13) {
+   __m256i round = _mm256_set1_epi32(1 << (VerticalShift-1));
+   __m256i packed = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(sum02, round), VerticalShift),
+                                       _mm256_srai_epi32(_mm256_add_epi32(sum13, round), VerticalShift));
+   return _mm256_min_epi16(_mm256_max_epi16(packed, _mm256_setzero_si256()), _mm256_set1_epi16(MaximumLinear));
+}
+
+IMAGEUTILS_TARGET_AVX2 static void filterColumnsLinearAVX2(const uint16_t *work, ptrdiff_t workPitch,
+                                                           const ImageResize::FixedContributorEntry &entry,
+                                                           uint32_t *output, int width) {
+   const uint8_t *toSRGB = ImageResize::getSRGBTable();
+   uint16_t lanes[32];
+   int k = 0;
+   for(; k+8<=width; k+=8) {
+      __m256i sum02 = _mm256_setzero_si256();
+      __m256i sum13 = _mm256_setzero_si256();
+      __m256i sum46 = _mm256_setzero_si256();
+      __m256i sum57 = _mm256_setzero_si256();
+      for(int j=0; j<entry.number; j+=2) {
+         //a missing second tap reads the first row again with a zero weight
+         int second = (j+1 < entry.number) ? j+1 : j;
+         const uint16_t *row0 = &work[(entry.p[j].pixelOffset*workPitch + k)*4];
+         const uint16_t *row1 = &work[(entry.p[second].pixelOffset*workPitch + k)*4];
+         __m256i weights = _mm256_broadcastsi128_si256(tapWeights(entry.p[j].weight,
+                                                                  (second != j) ? entry.p[second].weight : 0));
+         __m256i row0a = _mm256_loadu_si256((const __m256i*)row0);
+         __m256i row1a = _mm256_loadu_si256((const __m256i*)row1);
+         __m256i row0b = _mm256_loadu_si256((const __m256i*)(row0+16));
+         __m256i row1b = _mm256_loadu_si256((const __m256i*)(row1+16));
+         sum02 = _mm256_add_epi32(sum02, _mm256_madd_epi16(_mm256_unpacklo_epi16(row0a, row1a), weights));
+         sum13 = _mm256_add_epi32(sum13, _mm256_madd_epi16(_mm256_unpackhi_epi16(row0a, row1a), weights));
+         sum46 = _mm256_add_epi32(sum46, _mm256_madd_epi16(_mm256_unpacklo_epi16(row0b, row1b), weights));
+         sum57 = _mm256_add_epi32(sum57, _mm256_madd_epi16(_mm256_unpackhi_epi16(row0b, row1b), weights));
+      }
+      _mm256_storeu_si256((__m256i*)lanes, linearLanesAVX2(sum02, sum13));
+      _mm256_storeu_si256((__m256i*)(lanes+16), linearLanesAVX2(sum46, sum57));
+      for(int i=0; i<8; ++i)
+         output[k+i] = lanesToPixel(toSRGB, lanes+i*4);
+   }
+   if(k < width)
+      filterColumnsLinearSSE2(work+k*4, workPitch, entry, output+k, width-k);
+}
+#endif
+
+//=== filters chosen at runtime
+
+void ImageResize::calcContributors(ResizeFilter filter, ContributorEntry *contributors, uint32_t inputSize,
+                                   uint32_t outputSize, bool horizontal, uint32_t outputBegin, uint32_t outputEnd) {
+   switch(filter) {
+      case ResizeFilterBox:              calcContributors<BoxFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterTriangle:         calcContributors<TriangleFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterHermite:          calcContributors<HermiteFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterBell:             calcContributors<BellFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterCubicBSpline:     calcContributors<CubicBSplineFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterLanczos3:         calcContributors<Lanczos3Filter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterMitchell:         calcContributors<MitchellFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterCosine:           calcContributors<CosineFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterCatmullRom:       calcContributors<CatmullRomFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterQuadratic:        calcContributors<QuadraticFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterQuadraticBSpline: calcContributors<QuadraticBSplineFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      case ResizeFilterCubicConvolution: calcContributors<CubicConvolutionFilter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+      default:                           calcContributors<Lanczos8Filter>(contributors, inputSize, outputSize, horizontal, outputBegin, outputEnd); break;
+   }
+}
+
+const char *ImageResize::getFilterName(ResizeFilter filter) {
+   static const char *names[NumberResizeFilters] = {
+      "Box", "Triangle", "Hermite", "Bell", "CubicBSpline", "Lanczos3", "Mitchell", "Cosine", "CatmullRom",
+      "Quadratic", "QuadraticBSpline", "CubicConvolution", "Lanczos8"
+   };
+   return ((filter >= 0) && (filter < NumberResizeFilters)) ? names[filter] : "unknown";
+}
+
+bool ImageResize::parseFilter(const char *name, ResizeFilter &filter) {
+   for(int i=0; i<NumberResizeFilters; ++i) {
+      const char *candidate = getFilterName((ResizeFilter)i);
+      size_t j = 0;
+      while(candidate[j] && (tolower((unsigned char)candidate[j]) == tolower((unsigned char)name[j])))
+         j++;
+      if(!candidate[j] && !name[j]) {
+         filter = (ResizeFilter)i;
+         return true;
+      }
+   }
+   return false;
+}
+
+float ImageResize::getFilterRadius(ResizeFilter filter) {
+   switch(filter) {
+      case ResizeFilterBox:              return BoxFilter::getDefaultFilterRadius();
+      case ResizeFilterTriangle:         return TriangleFilter::getDefaultFilterRadius();
+      case ResizeFilterHermite:          return HermiteFilter::getDefaultFilterRadius();
+      case ResizeFilterBell:             return BellFilter::getDefaultFilterRadius();
+      case ResizeFilterCubicBSpline:     return CubicBSplineFilter::getDefaultFilterRadius();
+      case ResizeFilterLanczos3:         return Lanczos3Filter::getDefaultFilterRadius();
+      case ResizeFilterMitchell:         return MitchellFilter::getDefaultFilterRadius();
+      case ResizeFilterCosine:           return CosineFilter::getDefaultFilterRadius();
+      case ResizeFilterCatmullRom:       return CatmullRomFilter::getDefaultFilterRadius();
+      case ResizeFilterQuadratic:        return QuadraticFilter::getDefaultFilterRadius();
+      case ResizeFilterQuadraticBSpline: return QuadraticBSplineFilter::getDefaultFilterRadius();
+      case ResizeFilterCubicConvolution: return CubicConvolutionFilter::getDefaultFilterRadius();
+      default:                           return Lanczos8Filter::getDefaultFilterRadius();
+   }
+}
+
+bool ImageResize::hasNegativeLobes(ResizeFilter filter) {
+   switch(filter) {
+      case ResizeFilterBox:              return hasNegativeLobes<BoxFilter>();
+      case ResizeFilterTriangle:         return hasNegativeLobes<TriangleFilter>();
+      case ResizeFilterHermite:          return hasNegativeLobes<HermiteFilter>();
+      case ResizeFilterBell:             return hasNegativeLobes<BellFilter>();
+      case ResizeFilterCubicBSpline:     return hasNegativeLobes<CubicBSplineFilter>();
+      case ResizeFilterLanczos3:         return hasNegativeLobes<Lanczos3Filter>();
+      case ResizeFilterMitchell:         return hasNegativeLobes<MitchellFilter>();
+      case ResizeFilterCosine:           return hasNegativeLobes<CosineFilter>();
+      case ResizeFilterCatmullRom:       return hasNegativeLobes<CatmullRomFilter>();
+      case ResizeFilterQuadratic:        return hasNegativeLobes<QuadraticFilter>();
+      case ResizeFilterQuadraticBSpline: return hasNegativeLobes<QuadraticBSplineFilter>();
+      case ResizeFilterCubicConvolution: return hasNegativeLobes<CubicConvolutionFilter>();
+      default:                           return hasNegativeLobes<Lanczos8Filter>();
+   }
+}
+
+//=== order of the passes
+
+bool ImageResize::isVerticalFirst(uint32_t inputWidth, uint32_t inputHeight, uint32_t outputWidth,
+                                  uint32_t outputHeight, float filterRadius, bool negativeLobes) {
+   if(negativeLobes)
+      return false;
+   //the taps of an output pixel like calcContributors() spreads them, one more for the store
+   double tapsX = 2*filterRadius*eastl::max((double)inputWidth / outputWidth, 1.0) + 1;
+   double tapsY = 2*filterRadius*eastl::max((double)inputHeight / outputHeight, 1.0) + 1;
+   double output = (double)outputWidth*outputHeight;
+   double horizontalFirst = (double)outputWidth*inputHeight*tapsX + output*tapsY;
+   double verticalFirst = (double)inputWidth*outputHeight*tapsY + output*tapsX;
+   //the same scale on both axes costs the same either way and keeps the old order
+   return verticalFirst*5 < horizontalFirst*4;
+}
+
+void ImageResize::resamplePasses(Executor &executor, const ImageView &input, const ContributorEntry *horizontal,
+                                 const ContributorEntry *vertical, bool verticalFirst, const ImageView &output) {
+   if(!input.is32Bit() || !output.is32Bit())
+      return;
+   int inputSizeX = input.width;
+   int inputSizeY = input.height;
+   int outputSizeX = output.width;
+   int outputSizeY = output.height;
+   const Kernels &kernels = getKernels();
+
+   if(verticalFirst) {
+      //every output row from its input rows into a row of the band and from there horizontally
+      IMAGEUTILS_SCOPE(Instrument::StageResampleFused, outputSizeX*outputSizeY);
+      int parts = executor.getNumberJobs(outputSizeY, MinimumRows);
+      executor.run(parts, [&](int part) {
+         uint32_t *row = new uint32_t[eastl::max(inputSizeX, 1)];
+         int end = Executor::partBegin(0, outputSizeY, parts, part+1);
+         for(int i=Executor::partBegin(0, outputSizeY, parts, part); i<end; ++i) {
+            kernels.filterColumns(input.row<uint32_t>(0), input.pitch(), vertical[i], row, inputSizeX);
+            kernels.filterRow(row, horizontal, output.row<uint32_t>(i), outputSizeX);
+         }
+         delete[] row;
+      });
+      return;
+   }
+
+   int span = 0;
+   for(int i=0; i<outputSizeY; ++i) {
+      if(vertical[i].number > 0)
+         span = eastl::max(span, vertical[i].p[vertical[i].number-1].pixelOffset - vertical[i].p[0].pixelOffset + 1);
+   }
+   if(span <= FusedRows) {
+      //input row k is filtered into slot k % FusedRows of the ring of a band, the rows of an output
+      //row never share a slot. the vertical pass reads the slots with the weights of the rows
+      IMAGEUTILS_SCOPE(Instrument::StageResampleFused, outputSizeX*outputSizeY);
+      int parts = executor.getNumberJobs(outputSizeY, MinimumRows);
+      executor.run(parts, [&](int part) {
+         uint32_t *ring = new uint32_t[FusedRows*outputSizeX];
+         int slotRows[FusedRows];
+         for(int slot=0; slot<FusedRows; ++slot)
+            slotRows[slot] = -1;
+         Contributor slots[FusedRows];
+         int end = Executor::partBegin(0, outputSizeY, parts, part+1);
+         for(int i=Executor::partBegin(0, outputSizeY, parts, part); i<end; ++i) {
+            ContributorEntry entry = { vertical[i].number, slots, vertical[i].wsum };
+            for(int j=0; j<entry.number; ++j) {
+               int k = vertical[i].p[j].pixelOffset;
+               int slot = k % FusedRows;
+               if(slotRows[slot] != k) {
+                  kernels.filterRow(input.row<uint32_t>(k), horizontal, &ring[slot*outputSizeX], outputSizeX);
+                  slotRows[slot] = k;
+               }
+               slots[j].pixelOffset = slot;
+               slots[j].weight = vertical[i].p[j].weight;
+            }
+            kernels.filterColumns(ring, outputSizeX, entry, output.row<uint32_t>(i), outputSizeX);
+         }
+         delete[] ring;
+      });
+      return;
+   }
+
+   uint32_t *work = new uint32_t[(size_t)outputSizeX*inputSizeY];
+
+   //filter horizontally from input to work
+   {
+      IMAGEUTILS_SCOPE(Instrument::StageResampleHorizontal, outputSizeX*inputSizeY);
+      int parts = executor.getNumberJobs(inputSizeY, MinimumRows);
+      executor.run(parts, [&](int part) {
+         int end = Executor::partBegin(0, inputSizeY, parts, part+1);
+         for(int k=Executor::partBegin(0, inputSizeY, parts, part); k<end; ++k)
+            kernels.filterRow(input.row<uint32_t>(k), horizontal, &work[(size_t)k*outputSizeX], outputSizeX);
+      });
+   }
+
+   //filter vertically from work to output, row by row so both buffers are read and written in order
+   {
+      IMAGEUTILS_SCOPE(Instrument::StageResampleVertical, outputSizeX*outputSizeY);
+      int parts = executor.getNumberJobs(outputSizeY, MinimumRows);
+      executor.run(parts, [&](int part) {
+         int end = Executor::partBegin(0, outputSizeY, parts, part+1);
+         for(int i=Executor::partBegin(0, outputSizeY, parts, part); i<end; ++i)
+            kernels.filterColumns(work, outputSizeX, vertical[i], output.row<uint32_t>(i), outputSizeX);
+      });
+   }
+
+   delete[] work;
+}
+
+//=== linear light
+
+//sRGB bytes to linear light and back. the way back has an entry for every linear value rounded to
+//the nearest byte, so a byte that makes the round trip comes back unchanged
+struct LinearTables {
+   uint16_t toLinear[256];
+   uint8_t toSRGB[1 << ImageResize::LinearBits];
+   //toLinear moved into the lane of b, g and r of a pixel, one table after the other
+   uint64_t toLanes[3*256];
+
+   LinearTables() {
+      double maximum = MaximumLinear;
+      for(int i=0; i<256; ++i) {
+         double value = i/255.0;
+         double linear = (value <= 0.04045) ? value/12.92 : pow((value+0.055)/1.055, 2.4);
+         toLinear[i] = (uint16_t)(linear*maximum + 0.5);
+         for(int lane=0; lane<3; ++lane)
+            toLanes[lane*256 + i] = (uint64_t)toLinear[i] << (lane*16);
+      }
+      for(int i=0; i<=MaximumLinear; ++i) {
+         double linear = i/maximum;
+         double value = (linear <= 0.0031308) ? linear*12.92 : 1.055*pow(linear, 1/2.4) - 0.055;
+         toSRGB[i] = (uint8_t)(value*255 + 0.5);
+      }
+   }
+};
+
+static const LinearTables &getLinearTables() {
+   static const LinearTables tables;
+   return tables;
+}
+
+const uint16_t *ImageResize::getLinearTable() {
+   return getLinearTables().toLinear;
+}
+
+const uint8_t *ImageResize::getSRGBTable() {
+   return getLinearTables().toSRGB;
+}
+
+void ImageResize::toFixed(const ContributorEntry *contributors, FixedContributorEntry *fixed, uint32_t size) {
+   for(uint32_t i=0; i<size; ++i) {
+      const ContributorEntry &entry = contributors[i];
+      FixedContributorEntry &result = fixed[i];
+      result.number = (entry.wsum != 0) ? entry.number : 0;
+      result.p = new FixedContributor[eastl::max(entry.number, 1)];
+      int total = 0;
+      int largest = 0;
+      for(int j=0; j<result.number; ++j) {
+         //pmaddwd takes 16 bit weights
+         int weight = (int)floor(entry.p[j].weight / entry.wsum * FixedOne + 0.5f);
+         weight = eastl::max(eastl::min(weight, 32767), -32767);
+         result.p[j].pixelOffset = entry.p[j].pixelOffset;
+         result.p[j].weight = weight;
+         total += weight;
+         if(abs(weight) > abs(result.p[largest].weight))
+            largest = j;
+      }
+      //the rounding errors go to the biggest weight, so flat areas stay exactly flat
+      if(result.number > 0)
+         result.p[largest].weight = eastl::max(eastl::min(result.p[largest].weight + FixedOne - total, 32767), -32767);
+   }
+}
+
+void ImageResize::resampleLinear(ResizeFilter filter, const ImageView &input, const ImageView &output) {
+   SerialExecutor serial;
+   resampleLinear(serial, filter, input, output);
+}
+
+void ImageResize::resampleLinear(Executor &executor, ResizeFilter filter, const ImageView &input,
+                                 const ImageView &output) {
+   if(output.isEmpty() || input.isEmpty() || !output.is32Bit() || !input.is32Bit())
+      return;
+   int inputSizeX = input.width;
+   int inputSizeY = input.height;
+   int outputSizeX = output.width;
+   int outputSizeY = output.height;
+   const Kernels &kernels = getKernels();
+
+   FixedContributorEntry *horizontal = new FixedContributorEntry[outputSizeX];
+   FixedContributorEntry *vertical = new FixedContributorEntry[outputSizeY];
+   {
+      IMAGEUTILS_SCOPE(Instrument::StageResampleContributors, outputSizeX+outputSizeY);
+      ContributorEntry *contributors = new ContributorEntry[eastl::max(outputSizeX, outputSizeY)];
+      calcContributors(filter, contributors, inputSizeX, outputSizeX, true);
+      toFixed(contributors, horizontal, outputSizeX);
+      freeContributors(contributors, outputSizeX);
+      calcContributors(filter, contributors, inputSizeY, outputSizeY, false);
+      toFixed(contributors, vertical, outputSizeY);
+      freeContributors(contributors, outputSizeY);
+      delete[] contributors;
+   }
+
+   //four 16 bit lanes per pixel between the passes
+   uint16_t *work = new uint16_t[(size_t)outputSizeX*inputSizeY*4];
+
+   //every input row goes through the table into a buffer of its band and is filtered from there
+   {
+      IMAGEUTILS_SCOPE(Instrument::StageResampleHorizontal, outputSizeX*inputSizeY);
+      const uint64_t *toLinear = getLinearTables().toLanes;
+      int parts = executor.getNumberJobs(inputSizeY, MinimumRows);
+      executor.run(parts, [&](int part) {
+         uint16_t *linear = new uint16_t[(size_t)inputSizeX*4];
+         int end = Executor::partBegin(0, inputSizeY, parts, part+1);
+         for(int k=Executor::partBegin(0, inputSizeY, parts, part); k<end; ++k) {
+            const uint32_t *row = input.row<uint32_t>(k);
+            uint64_t *lanes = (uint64_t*)linear;
+            for(int x=0; x<inputSizeX; ++x) {
+               uint32_t pixel = row[x];
+               lanes[x] = toLinear[pixel & 0xff] | toLinear[256 + ((pixel >> 8) & 0xff)] | toLinear[512 + ((pixel >> 16) & 0xff)];
+            }
+            kernels.filterRowLinear(linear, horizontal, &work[(size_t)k*outputSizeX*4], outputSizeX);
+         }
+         delete[] linear;
+      });
+   }
+
+   {
+      IMAGEUTILS_SCOPE(Instrument::StageResampleVertical, outputSizeX*outputSizeY);
+      int parts = executor.getNumberJobs(outputSizeY, MinimumRows);
+      executor.run(parts, [&](int part) {
+         int end = Executor::partBegin(0, outputSizeY, parts, part+1);
+         for(int i=Executor::partBegin(0, outputSizeY, parts, part); i<end; ++i)
+            kernels.filterColumnsLinear(work, outputSizeX, vertical[i], output.row<uint32_t>(i), outputSizeX);
+      });
+   }
+
+   freeContributors(horizontal, outputSizeX);
+   freeContributors(vertical, outputSizeY);
+   delete[] horizontal;
+   delete[] vertical;
+   delete[] work;
+}
+
+//=== out of core
+
+void ImageResize::resampleStrips(ResizeFilter filter, RowSource &input, RowSink &output, size_t memoryBudget) {
+   SerialExecutor serial;
+   resampleStrips(serial, filter, input, output, memoryBudget);
+}
+
+void ImageResize::resampleStrips(Executor &executor, ResizeFilter filter, RowSource &input, RowSink &output,
+                                 size_t memoryBudget) {
+   int inputSizeX = input.getWidth();
+   int inputSizeY = input.getHeight();
+   int outputSizeX = output.getWidth();
+   int outputSizeY = output.getHeight();
+   if((inputSizeX <= 0) || (inputSizeY <= 0) || (outputSizeX <= 0) || (outputSizeY <= 0))
+      return;
+   const Kernels &kernels = getKernels();
+
+   ContributorEntry *horizontal = new ContributorEntry[outputSizeX];
+   {
+      IMAGEUTILS_SCOPE(Instrument::StageResampleContributors, outputSizeX);
+      calcContributors(filter, horizontal, inputSizeX, outputSizeX, true);
+   }
+
+   //the window holds the input rows [windowBegin, windowEnd), horizontally filtered unless the
+   //vertical pass goes first like it does in resample()
+   bool verticalFirst = isVerticalFirst(inputSizeX, inputSizeY, outputSizeX, outputSizeY, filter);
+   int windowWidth = verticalFirst ? inputSizeX : outputSizeX;
+   size_t rowBytes = (size_t)windowWidth*sizeof(uint32_t);
+   int budgetRows = (int)eastl::min(eastl::max(memoryBudget / rowBytes, (size_t)1), (size_t)inputSizeY);
+   int windowCapacity = 0;
+   int windowBegin = 0;
+   int windowEnd = 0;
+   uint32_t *window = nullptr;
+
+   //output rows per strip, so that the input rows of a strip about fill the budget
+   int stripRows = (int)eastl::max((int64_t)budgetRows*outputSizeY / inputSizeY, (int64_t)1);
+   ContributorEntry *vertical = new ContributorEntry[eastl::min(stripRows, outputSizeY)];
+
+   for(int stripBegin=0; stripBegin<outputSizeY; ) {
+      //the input rows of the strip, fewer output rows as long as they don't fit
+      int stripEnd, rowBegin, rowEnd;
+      for(;;) {
+         stripEnd = eastl::min(stripBegin+stripRows, outputSizeY);
+         IMAGEUTILS_SCOPE(Instrument::StageResampleContributors, stripEnd-stripBegin);
+         calcContributors(filter, vertical, inputSizeY, outputSizeY, false, stripBegin, stripEnd);
+         rowBegin = inputSizeY;
+         rowEnd = 0;
+         for(int i=0; i<stripEnd-stripBegin; ++i) {
+            for(int j=0; j<vertical[i].number; ++j) {
+               rowBegin = eastl::min(rowBegin, vertical[i].p[j].pixelOffset);
+               rowEnd = eastl::max(rowEnd, vertical[i].p[j].pixelOffset+1);
+            }
+         }
+         if((rowEnd-rowBegin <= budgetRows) || (stripRows == 1))
+            break;
+         freeContributors(vertical, stripEnd-stripBegin);
+         stripRows = eastl::max(stripRows/2, 1);
+      }
+      if(rowEnd < rowBegin)
+         rowBegin = rowEnd = windowEnd;
+
+      //keep the rows the strip shares with the last one. the window only moves down, except when a
+      //skipped zero weight made the last strip start a row late
+      if(rowBegin < windowBegin)
+         windowBegin = windowEnd = rowBegin;
+      int keepBegin = eastl::max(rowBegin, windowBegin);
+      int keepEnd = eastl::max(keepBegin, windowEnd);
+      if(rowEnd-rowBegin > windowCapacity) {
+         windowCapacity = rowEnd-rowBegin;
+         uint32_t *grown = new uint32_t[(size_t)windowCapacity*windowWidth];
+         if(keepEnd > keepBegin)
+            memcpy(grown, &window[(size_t)(keepBegin-windowBegin)*windowWidth], (keepEnd-keepBegin)*rowBytes);
+         delete[] window;
+         window = grown;
+      } else if((keepEnd > keepBegin) && (keepBegin > windowBegin)) {
+         memmove(window, &window[(size_t)(keepBegin-windowBegin)*windowWidth], (keepEnd-keepBegin)*rowBytes);
+      }
+      windowBegin = rowBegin;
+      int firstNew = eastl::max(keepEnd, rowBegin);
+
+      //filter the new rows horizontally into the window, or just read them
+      if(verticalFirst) {
+         for(int k=firstNew; k<rowEnd; ++k) {
+            uint32_t *row = &window[(size_t)(k-windowBegin)*windowWidth];
+            const uint32_t *read = input.readRow(k, row);
+            if(read != row)
+               memcpy(row, read, rowBytes);
+         }
+      } else {
+         int rows = rowEnd-firstNew;
+         IMAGEUTILS_SCOPE(Instrument::StageResampleHorizontal, outputSizeX*rows);
+         int parts = executor.getNumberJobs(rows, MinimumRows);
+         executor.run(parts, [&](int part) {
+            uint32_t *buffer = new uint32_t[inputSizeX];
+            int end = firstNew + Executor::partBegin(0, rows, parts, part+1);
+            for(int k=firstNew + Executor::partBegin(0, rows, parts, part); k<end; ++k)
+               kernels.filterRow(input.readRow(k, buffer), horizontal,
+                                 &window[(size_t)(k-windowBegin)*outputSizeX], outputSizeX);
+            delete[] buffer;
+         });
+      }
+      windowEnd = rowEnd;
+      input.releaseRows(rowBegin);
+
+      //filter the strip vertically from the window to the output
+      {
+         int rows = stripEnd-stripBegin;
+         for(int i=0; i<rows; ++i) {
+            for(int j=0; j<vertical[i].number; ++j)
+               vertical[i].p[j].pixelOffset -= windowBegin;
+         }
+         IMAGEUTILS_SCOPE(verticalFirst ? Instrument::StageResampleFused : Instrument::StageResampleVertical,
+                          outputSizeX*rows);
+         int parts = executor.getNumberJobs(rows, MinimumRows);
+         executor.run(parts, [&](int part) {
+            uint32_t *buffer = new uint32_t[outputSizeX];
+            uint32_t *columns = verticalFirst ? new uint32_t[inputSizeX] : nullptr;
+            int end = Executor::partBegin(0, rows, parts, part+1);
+            for(int i=Executor::partBegin(0, rows, parts, part); i<end; ++i) {
+               uint32_t *row = output.beginRow(stripBegin+i, buffer);
+               if(verticalFirst) {
+                  kernels.filterColumns(window, windowWidth, vertical[i], columns, inputSizeX);
+                  kernels.filterRow(columns, horizontal, row, outputSizeX);
+               } else {
+                  kernels.filterColumns(window, windowWidth, vertical[i], row, outputSizeX);
+               }
+               output.endRow(stripBegin+i, row);
+            }
+            delete[] columns;
+            delete[] buffer;
+         });
+      }
+      freeContributors(vertical, stripEnd-stripBegin);
+      output.releaseRows(stripEnd);
+      stripBegin = stripEnd;
+   }
+
+   freeContributors(horizontal, outputSizeX);
+   delete[] horizontal;
+   delete[] vertical;
+   delete[] window;
+}
+
+//=== halving
+
+void ImageResize::halve(const ImageView &input, const ImageView &output) {
+   if(!input.is32Bit() || !output.is32Bit())
+      return;
+   int width = input.width;
+   int height = input.height;
+   for(int y=0; y<output.height; ++y) {
+      const uint32_t *line0 = input.row<uint32_t>(y*2);
+      const uint32_t *line1 = (y*2+1 < height) ? input.row<uint32_t>(y*2+1) : line0;
+      uint32_t *dst = output.row<uint32_t>(y);
+      for(int x=0; x<output.width; ++x) {
+         int x0 = x*2;
+         int x1 = (x0+1 < width) ? x0+1 : x0;
+         uint32_t a = line0[x0], b = line0[x1], c = line1[x0], d = line1[x1];
+         uint32_t rb = (a & 0xff00ff) + (b & 0xff00ff) + (c & 0xff00ff) + (d & 0xff00ff) + 0x020002;
+         uint32_t g  = (a & 0x00ff00) + (b & 0x00ff00) + (c & 0x00ff00) + (d & 0x00ff00) + 0x000200;
+         dst[x] = ((rb >> 2) & 0xff00ff) | ((g >> 2) & 0x00ff00);
+      }
+   }
+}
+
+//=== dispatch
+
+const ImageResize::Kernels &ImageResize::getKernels(CpuLevel level) {
+   static const Kernels scalar = { filterRowScalar, filterColumnsScalar, filterRowLinearScalar, filterColumnsLinearScalar };
+#ifdef IMAGEUTILS_SSE2
+   static const Kernels sse2 = { filterRowSSE2, filterColumnsSSE2, filterRowLinearSSE2, filterColumnsLinearSSE2 };
+   if(level == CpuLevelSSE2)
+      return sse2;
+#endif
+#ifdef IMAGEUTILS_AVX2
+   //the horizontal linear pass loads single taps, it stays with the sse2 kernel
+   static const Kernels avx2 = { filterRowAVX2, filterColumnsAVX2, filterRowLinearSSE2, filterColumnsLinearAVX2 };
+   if(level >= CpuLevelAVX2)
+      return avx2;
+#endif
+   return scalar;
+}
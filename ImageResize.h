@@ -20,6 +20,10 @@
 */
 
 #include "eastl/types.h"
+#include "image.h"
+#include "instrument.h"
+#include "cpufeatures.h"
+#include "threadpool.h"
 
 #include <math.h>
 
@@ -197,188 +201,327 @@ struct Lanczos8Filter {
    }
 };
 
+//the filters above as a value, for choosing them at runtime
+enum ResizeFilter {
+   ResizeFilterBox,
+   ResizeFilterTriangle,
+   ResizeFilterHermite,
+   ResizeFilterBell,
+   ResizeFilterCubicBSpline,
+   ResizeFilterLanczos3,
+   ResizeFilterMitchell,
+   ResizeFilterCosine,
+   ResizeFilterCatmullRom,
+   ResizeFilterQuadratic,
+   ResizeFilterQuadraticBSpline,
+   ResizeFilterCubicConvolution,
+   ResizeFilterLanczos8,
+   NumberResizeFilters
+};
 
 class ImageResize {
-   typedef struct {
+public:
+   struct Contributor {
       int pixelOffset;
       float weight;
-   } Contributor;
-   typedef struct {
+   };
+   struct ContributorEntry {
       int number;
       Contributor *p;
       float wsum;
-   } ContributorEntry;
+   };
 
-public:
+   //the contributors in fixed point for the integer kernels of the linear light resample, the
+   //weights of an entry add up to FixedOne
+   struct FixedContributor {
+      int pixelOffset;
+      int weight;
+   };
+   struct FixedContributorEntry {
+      int number;
+      FixedContributor *p;
+   };
+   enum {
+      FixedBits = 14,
+      FixedOne = 1 << FixedBits,
+      LinearBits = 12,           //linear light of the input and the output of the filter
+      LinearWorkBits = 15        //linear light between the passes, 16 bit lanes that pmaddwd can take
+   };
+
+   //the inner loops of both passes, one line at a time. every level gives the same bits as the
+   //scalar kernels, the float operations of a channel happen in the same order
+   struct Kernels {
+      //one row of the horizontal pass, output[i] is filtered from the contributors[i] of input
+      void (*filterRow)(const uint32_t *input, const ContributorEntry *contributors, uint32_t *output, int outputSize);
+      //one row of the vertical pass, output[k] is filtered from column k of the rows entry.p[j] of
+      //work. workPitch is in pixels
+      void (*filterColumns)(const uint32_t *work, ptrdiff_t workPitch, const ContributorEntry &entry,
+                            uint32_t *output, int width);
+      //the same for the linear light resample, on pixels of four 16 bit lanes [b, g, r, a]. the
+      //input of the row is in LinearBits, the work in LinearWorkBits, the output goes back to sRGB
+      void (*filterRowLinear)(const uint16_t *input, const FixedContributorEntry *contributors, uint16_t *output,
+                              int outputSize);
+      void (*filterColumnsLinear)(const uint16_t *work, ptrdiff_t workPitch, const FixedContributorEntry &entry,
+                                  uint32_t *output, int width);
+   };
+   static const Kernels &getKernels(CpuLevel level);
+   static const Kernels &getKernels() { return getKernels(CpuFeatures::getLevel()); }
+
+   //returns a new[]'ed picture of outputSizeX*outputSizeY pixels
    template<class filter> static uint32_t *resample(uint32_t inputSizeX, uint32_t inputSizeY, uint32_t *input, 
                      uint32_t outputSizeX, uint32_t outputSizeY);
+   //resamples the 32 bit input view into the 32 bit output view, both may have any stride (crops
+   //of bigger pictures for example). the output has to be allocated by the caller
+   template<class filter> static void resample(const ImageView &input, const ImageView &output);
+   //the same, with bands of rows of both passes run as jobs of the executor. same result
+   template<class filter> static void resample(Executor &executor, const ImageView &input, const ImageView &output);
+
+   //rows of the smallest band a pass is split into
+   enum { MinimumRows = 8 };
+
+   //the order of the passes from a cost model of both: the pixels of the buffer between them times
+   //the taps that fill it, plus the output times the taps of the second pass. vertical first only
+   //when that is clearly cheaper, wide upscales and tall downscales for example, and never for
+   //filters with negative lobes: the buffer between the passes is clamped to bytes, their overshoot
+   //would be cut at other places and the result would depend on the shape of the picture. without
+   //them the orders only round at different places and differ by a step here and there
+   static bool isVerticalFirst(uint32_t inputWidth, uint32_t inputHeight, uint32_t outputWidth,
+                               uint32_t outputHeight, float filterRadius, bool negativeLobes);
+   static bool isVerticalFirst(uint32_t inputWidth, uint32_t inputHeight, uint32_t outputWidth,
+                               uint32_t outputHeight, ResizeFilter filter) {
+      return isVerticalFirst(inputWidth, inputHeight, outputWidth, outputHeight, getFilterRadius(filter),
+                             hasNegativeLobes(filter));
+   }
+   template<class filter> static bool isVerticalFirst(uint32_t inputWidth, uint32_t inputHeight,
+                                                      uint32_t outputWidth, uint32_t outputHeight) {
+      return isVerticalFirst(inputWidth, inputHeight, outputWidth, outputHeight, filter::getDefaultFilterRadius(),
+                             hasNegativeLobes<filter>());
+   }
+   static float getFilterRadius(ResizeFilter filter);
+   //whether the filter goes below 0 anywhere within its radius, sampled once per filter
+   template<class filter> static bool hasNegativeLobes() {
+      static const bool negative = [] {
+         float radius = filter::getDefaultFilterRadius();
+         for(int i=0; i<=1000; ++i) {
+            if(filter::getValue(radius*i/1000.0f) < 0)
+               return true;
+         }
+         return false;
+      }();
+      return negative;
+   }
+   static bool hasNegativeLobes(ResizeFilter filter);
+   //both passes with contributors of the caller, their offsets relative to the input view. vertical
+   //first filters the input rows of an output row into one row and that into the output row.
+   //horizontal first keeps a ring of FusedRows filtered rows when no output row needs more of them
+   //(small kernels when upscaling), else a buffer of all of them
+   static void resamplePasses(Executor &executor, const ImageView &input, const ContributorEntry *horizontal,
+                              const ContributorEntry *vertical, bool verticalFirst, const ImageView &output);
+   enum { FusedRows = 4 };
+
+   //one tile of a resample to outputWidth x outputHeight: the output view gets the pixels
+   //[x, x+output.width) x [y, y+output.height) of the full result, down to the bit, so tiles line up
+   //without seams. only the input rows and columns under the tile are filtered, the cost depends on
+   //the tile and not on the full output. nothing happens if the tile is not inside the full output
+   template<class filter> static void resampleRegion(const ImageView &input, uint32_t outputWidth, uint32_t outputHeight,
+                                                     int x, int y, const ImageView &output);
+   template<class filter> static void resampleRegion(Executor &executor, const ImageView &input, uint32_t outputWidth,
+                                                     uint32_t outputHeight, int x, int y, const ImageView &output);
+
+   //for pictures that don't fit into memory: the input is read and the output written strip by
+   //strip, see RowSource and RowSink. the output size is the size of the sink. besides the
+   //contributors of one output row only a window of horizontally filtered rows (input rows when
+   //the vertical pass goes first) is kept, as many as fit into memoryBudget bytes but at least the
+   //ones a single output row needs. same result as resample()
+   static void resampleStrips(ResizeFilter filter, RowSource &input, RowSink &output,
+                              size_t memoryBudget = DefaultStripBudget);
+   static void resampleStrips(Executor &executor, ResizeFilter filter, RowSource &input, RowSink &output,
+                              size_t memoryBudget = DefaultStripBudget);
+
+   enum { DefaultStripBudget = 64 << 20 };
+
+   //resample() in linear light: the sRGB input goes through a table to LinearBits of linear light
+   //as the rows enter the horizontal pass, both passes filter in fixed point and the output comes
+   //back to sRGB through a table of every linear value. downscaled edges and fine patterns keep
+   //their brightness instead of getting darker. alpha is cleared like in resample()
+   static void resampleLinear(ResizeFilter filter, const ImageView &input, const ImageView &output);
+   static void resampleLinear(Executor &executor, ResizeFilter filter, const ImageView &input, const ImageView &output);
+   //the tables of resampleLinear(): 256 sRGB bytes to linear light and 1 << LinearBits back
+   static const uint16_t *getLinearTable();
+   static const uint8_t *getSRGBTable();
+   //the weights of contributors divided by wsum in fixed point, rounded so they add up to FixedOne
+   static void toFixed(const ContributorEntry *contributors, FixedContributorEntry *fixed, uint32_t size);
+   static void freeContributors(FixedContributorEntry *contributors, uint32_t size) {
+      for(unsigned int i=0; i<size; ++i)
+         delete[] contributors[i].p;
+   }
+
+   //fills contributors[0..outputSize) for one axis. horizontal upsampling rounds the filter window
+   //outwards, the other three cases truncate it (kept like this so results don't change)
+   template<class filter> static void calcContributors(ContributorEntry *contributors, uint32_t inputSize,
+                                                       uint32_t outputSize, bool horizontal) {
+      calcContributors<filter>(contributors, inputSize, outputSize, horizontal, 0, outputSize);
+   }
+   //only the outputs [outputBegin, outputEnd) into contributors[0..outputEnd-outputBegin)
+   template<class filter> static void calcContributors(ContributorEntry *contributors, uint32_t inputSize,
+                                                       uint32_t outputSize, bool horizontal,
+                                                       uint32_t outputBegin, uint32_t outputEnd);
+   //the same with the filter chosen at runtime
+   static void calcContributors(ResizeFilter filter, ContributorEntry *contributors, uint32_t inputSize,
+                                uint32_t outputSize, bool horizontal) {
+      calcContributors(filter, contributors, inputSize, outputSize, horizontal, 0, outputSize);
+   }
+   static void calcContributors(ResizeFilter filter, ContributorEntry *contributors, uint32_t inputSize,
+                                uint32_t outputSize, bool horizontal, uint32_t outputBegin, uint32_t outputEnd);
+   static const char *getFilterName(ResizeFilter filter);
+   //the filter of a name of getFilterName(), case doesn't matter
+   static bool parseFilter(const char *name, ResizeFilter &filter);
+
+   //halves the input into the output of ((width+1)/2, (height+1)/2) pixels, every output pixel is
+   //the rounded average of a 2x2 block. an odd last row or column is averaged with itself
+   static void halve(const ImageView &input, const ImageView &output);
+
+   static void freeContributors(ContributorEntry *contributors, uint32_t size) {
+      for(unsigned int i=0; i<size; ++i)
+         delete[] contributors[i].p;
+   }
 };
 
 template<class filter> uint32_t *ImageResize::resample(uint32_t inputSizeX, uint32_t inputSizeY, uint32_t *input, 
                                                        uint32_t outputSizeX, uint32_t outputSizeY) {
-    uint32_t *work = new uint32_t[outputSizeX * inputSizeY];
     uint32_t *output = new uint32_t[outputSizeX * outputSizeY];
+    resample<filter>(ImageView::fromPixels(input, inputSizeX, inputSizeY),
+                     ImageView::fromPixels(output, outputSizeX, outputSizeY));
+    return output;
+}
 
-    float scaleX = (float)outputSizeX / (float)inputSizeX;
-    float scaleY = (float)outputSizeY / (float)inputSizeY;
-
-    size_t contributorSize = eastl::max(outputSizeX, outputSizeY);
-    ContributorEntry *contributors = new ContributorEntry[contributorSize];
+template<class filter> void ImageResize::calcContributors(ContributorEntry *contributors, uint32_t inputSize,
+                                                          uint32_t outputSize, bool horizontal,
+                                                          uint32_t outputBegin, uint32_t outputEnd) {
+    float scale = (float)outputSize / (float)inputSize;
 
-    if(scaleX < 1.0f) {
-       //scales from bigger to smaller width
-       float wdth = filter::getDefaultFilterRadius() / scaleX;
+    if(scale < 1.0f) {
+       //scales from bigger to smaller size
+       float wdth = filter::getDefaultFilterRadius() / scale;
 
-       for(unsigned int i=0; i<outputSizeX; ++i) {
-          contributors[i].number = 0;
-          contributors[i].p = new Contributor[(int)floor(2*wdth+1)];
-          contributors[i].wsum = 0;
-          float center = (i+0.5f)/scaleX;
+       for(unsigned int i=outputBegin; i<outputEnd; ++i) {
+          ContributorEntry &entry = contributors[i-outputBegin];
+          entry.number = 0;
+          entry.p = new Contributor[(int)floor(2*wdth+1)];
+          entry.wsum = 0;
+          float center = (i+0.5f)/scale;
           int left = (int)(center-wdth);
           int right = (int)(center+wdth);
 
           for(int j=left; j<=right; ++j) {
-             float weight = filter::getValue((center-j-0.5f)*scaleX);
-             if((weight == 0) || (j < 0) || (j >= (signed int)inputSizeX))
+             float weight = filter::getValue((center-j-0.5f)*scale);
+             if((weight == 0) || (j < 0) || (j >= (signed int)inputSize))
                 continue;
-             contributors[i].p[contributors[i].number].pixelOffset = j;
-             contributors[i].p[contributors[i].number].weight = weight;
-             contributors[i].wsum += weight;
-             contributors[i].number++;
+             entry.p[entry.number].pixelOffset = j;
+             entry.p[entry.number].weight = weight;
+             entry.wsum += weight;
+             entry.number++;
           }
        }
     } else {
-       //scales from smaller to bigger width
-       for(unsigned int i=0; i<outputSizeX; ++i) {
-          contributors[i].number = 0;
-          contributors[i].p = new Contributor[(int)floor(2*filter::getDefaultFilterRadius()+1)];
-          contributors[i].wsum = 0;
-          float center = (i+0.5f)/scaleX;
-          int left = (int)floor(center-filter::getDefaultFilterRadius());
-          int right = (int)ceil(center+filter::getDefaultFilterRadius());
+       //scales from smaller to bigger size
+       for(unsigned int i=outputBegin; i<outputEnd; ++i) {
+          ContributorEntry &entry = contributors[i-outputBegin];
+          entry.number = 0;
+          entry.p = new Contributor[(int)floor(2*filter::getDefaultFilterRadius()+1)];
+          entry.wsum = 0;
+          float center = (i+0.5f)/scale;
+          int left, right;
+          if(horizontal) {
+             left = (int)floor(center-filter::getDefaultFilterRadius());
+             right = (int)ceil(center+filter::getDefaultFilterRadius());
+          } else {
+             left = (int)(center-filter::getDefaultFilterRadius());
+             right = (int)(center+filter::getDefaultFilterRadius());
+          }
 
           for(int j=left; j<=right; ++j) {
              float weight = filter::getValue(center-j-0.5f);
-             if((weight == 0) || (j < 0) || (j >= (signed int)inputSizeX))
+             if((weight == 0) || (j < 0) || (j >= (signed int)inputSize))
                 continue;
-             contributors[i].p[contributors[i].number].pixelOffset = j;
-             contributors[i].p[contributors[i].number].weight = weight;
-             contributors[i].wsum += weight;
-             contributors[i].number++;
+             entry.p[entry.number].pixelOffset = j;
+             entry.p[entry.number].weight = weight;
+             entry.wsum += weight;
+             entry.number++;
           }
        }
     }
+}
 
-    //filter horizontally from input to work
-    for(unsigned int k=0; k<inputSizeY; ++k) {
-       for(unsigned int i=0; i<outputSizeX; ++i) {
-          float intensityR = 0;
-          float intensityG = 0;
-          float intensityB = 0;
-          for(int j=0; j<contributors[i].number; ++j) {
-             float weight = contributors[i].p[j].weight;
-             //            intensity += input[contributors[i].p[j].pixelOffset + inputSizeX*4*k]*weight;
-             uint32_t sourcePixel = input[contributors[i].p[j].pixelOffset + inputSizeX*k];
-             intensityR += ((sourcePixel&0x00ff0000) >> 16) * weight;
-             intensityG += ((sourcePixel&0x0000ff00) >> 8) * weight;
-             intensityB +=  (sourcePixel&0x000000ff) * weight;
-          }
-          intensityR /= contributors[i].wsum;
-          intensityG /= contributors[i].wsum;
-          intensityB /= contributors[i].wsum;
-          if(intensityR < 0) intensityR = 0;
-          if(intensityR > 255) intensityR = 255;
-          if(intensityG < 0) intensityG = 0;
-          if(intensityG > 255) intensityG = 255;
-          if(intensityB < 0) intensityB = 0;
-          if(intensityB > 255) intensityB = 255;
-          //         work[i,k] = min(max(intensity/contributors[i].wsum, minValue), MaxValue);
-          work[i+k*outputSizeX] = (((int)intensityR)<<16) | (((int)intensityG)<<8) | ((int)intensityB);
-       }
-    }
+template<class filter> void ImageResize::resample(const ImageView &input, const ImageView &output) {
+    SerialExecutor serial;
+    resample<filter>(serial, input, output);
+}
+
+template<class filter> void ImageResize::resample(Executor &executor, const ImageView &input, const ImageView &output) {
+    resampleRegion<filter>(executor, input, output.width, output.height, 0, 0, output);
+}
 
-    for(unsigned int i=0; i<outputSizeX; ++i) {
-       delete[] contributors[i].p;
+template<class filter> void ImageResize::resampleRegion(const ImageView &input, uint32_t outputWidth,
+                                                        uint32_t outputHeight, int x, int y, const ImageView &output) {
+    SerialExecutor serial;
+    resampleRegion<filter>(serial, input, outputWidth, outputHeight, x, y, output);
+}
+
+template<class filter> void ImageResize::resampleRegion(Executor &executor, const ImageView &input, uint32_t outputWidth,
+                                                        uint32_t outputHeight, int x, int y, const ImageView &output) {
+    if((x < 0) || (y < 0) || (x+output.width > (int)outputWidth) || (y+output.height > (int)outputHeight))
+       return;
+    if(output.isEmpty() || input.isEmpty() || !output.is32Bit() || !input.is32Bit())
+       return;
+    uint32_t inputSizeX = input.width;
+    uint32_t inputSizeY = input.height;
+    uint32_t tileSizeX = output.width;
+    uint32_t tileSizeY = output.height;
+
+    ContributorEntry *horizontal = new ContributorEntry[tileSizeX];
+    ContributorEntry *vertical = new ContributorEntry[tileSizeY];
+    {
+       IMAGEUTILS_SCOPE(Instrument::StageResampleContributors, tileSizeX+tileSizeY);
+       calcContributors<filter>(horizontal, inputSizeX, outputWidth, true, x, x+tileSizeX);
+       calcContributors<filter>(vertical, inputSizeY, outputHeight, false, y, y+tileSizeY);
     }
 
-    //pre-calculate filter contributions for a column
-    if(scaleY < 1.0f) {
-       //scales from bigger to smaller height
-       float wdth = filter::getDefaultFilterRadius() / scaleY;
-       for(unsigned int i=0; i<outputSizeY; ++i) {
-          contributors[i].number = 0;
-          contributors[i].p = new Contributor[(int)floor(2*wdth+1)];
-          contributors[i].wsum = 0;
-          float center = (i+0.5f)/scaleY;
-          int left = (int)(center-wdth);
-          int right = (int)(center+wdth);
-          for(int j=left; j<=right; ++j) {
-             float weight = filter::getValue((center-j-0.5f)*scaleY);
-             if((weight==0) || (j<0) || (j>=(signed int)inputSizeY))
-                continue;
-             contributors[i].p[contributors[i].number].pixelOffset = j;
-             contributors[i].p[contributors[i].number].weight = weight;
-             contributors[i].wsum += weight;
-             contributors[i].number++;
-          }
-       }
-    } else {
-       //vertical upsampling
-       for(unsigned int i=0; i<outputSizeY; ++i) {
-          contributors[i].number = 0;
-          contributors[i].p = new Contributor[(int)floor(2*filter::getDefaultFilterRadius()+1)];
-          contributors[i].wsum = 0;
-          float center = (i+0.5f)/scaleY;
-          int left = (int)(center-filter::getDefaultFilterRadius());
-          int right = (int)(center+filter::getDefaultFilterRadius());
-          for(int j=left; j<=right; ++j) {
-             float weight = filter::getValue(center-j-0.5f);
-             if((weight==0) || (j<0) || (j>=(signed int)inputSizeY))
-                continue;
-             contributors[i].p[contributors[i].number].pixelOffset = j;
-             contributors[i].p[contributors[i].number].weight = weight;
-             contributors[i].wsum += weight;
-             contributors[i].number++;
-          }
+    //the input rows and columns under the tile, the passes see only that crop of the input
+    int rowBegin = inputSizeY, rowEnd = 0;
+    int columnBegin = inputSizeX, columnEnd = 0;
+    for(unsigned int i=0; i<tileSizeY; ++i) {
+       for(int j=0; j<vertical[i].number; ++j) {
+          rowBegin = eastl::min(rowBegin, vertical[i].p[j].pixelOffset);
+          rowEnd = eastl::max(rowEnd, vertical[i].p[j].pixelOffset+1);
        }
     }
-
-    //filter vertically from work to output
-    for(unsigned int k=0; k<outputSizeX; ++k) {
-       for(unsigned int i=0; i<outputSizeY; ++i) {
-          float intensityR = 0;
-          float intensityG = 0;
-          float intensityB = 0;
-          for(int j=0; j<contributors[i].number; ++j) {
-             float weight = contributors[i].p[j].weight;
-             //            intensity += work[k, contributors[i].p[j].pixelOffset]*weight;
-
-             uint32_t sourcePixel = work[contributors[i].p[j].pixelOffset*outputSizeX + k];
-             intensityR += ((sourcePixel&0x00ff0000) >> 16) * weight;
-             intensityG += ((sourcePixel&0x0000ff00) >> 8) * weight;
-             intensityB +=  (sourcePixel&0x000000ff) * weight;
-          }
-          //         output[k,i] = min(max(intensity/contributors[i].wsum, minValue), MaxValue);
-          intensityR /= contributors[i].wsum;
-          intensityG /= contributors[i].wsum;
-          intensityB /= contributors[i].wsum;
-          if(intensityR < 0) intensityR = 0;
-          if(intensityR > 255) intensityR = 255;
-          if(intensityG < 0) intensityG = 0;
-          if(intensityG > 255) intensityG = 255;
-          if(intensityB < 0) intensityB = 0;
-          if(intensityB > 255) intensityB = 255;
-          output[k+i*outputSizeX] = (((int)intensityR)<<16) | (((int)intensityG)<<8) | ((int)intensityB);
+    for(unsigned int i=0; i<tileSizeX; ++i) {
+       for(int j=0; j<horizontal[i].number; ++j) {
+          columnBegin = eastl::min(columnBegin, horizontal[i].p[j].pixelOffset);
+          columnEnd = eastl::max(columnEnd, horizontal[i].p[j].pixelOffset+1);
        }
     }
-
-    for(unsigned int i=0; i<outputSizeY; ++i) {
-       delete[] contributors[i].p;
+    rowBegin = eastl::min(rowBegin, rowEnd);
+    columnBegin = eastl::min(columnBegin, columnEnd);
+    for(unsigned int i=0; i<tileSizeY; ++i) {
+       for(int j=0; j<vertical[i].number; ++j)
+          vertical[i].p[j].pixelOffset -= rowBegin;
+    }
+    for(unsigned int i=0; i<tileSizeX; ++i) {
+       for(int j=0; j<horizontal[i].number; ++j)
+          horizontal[i].p[j].pixelOffset -= columnBegin;
     }
-    delete[] contributors;
 
-    delete[] work;
-    return output;
+    //the order comes from the full output, so every tile filters like the whole picture does
+    bool verticalFirst = isVerticalFirst<filter>(inputSizeX, inputSizeY, outputWidth, outputHeight);
+    resamplePasses(executor, input.crop(columnBegin, rowBegin, columnEnd-columnBegin, rowEnd-rowBegin),
+                   horizontal, vertical, verticalFirst, output);
+
+    freeContributors(horizontal, tileSizeX);
+    freeContributors(vertical, tileSizeY);
+    delete[] horizontal;
+    delete[] vertical;
 }
 
 
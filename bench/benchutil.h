@@ -0,0 +1,51 @@
+
+#ifndef __IMAGEUTILS_BENCHUTIL_H__
+#define __IMAGEUTILS_BENCHUTIL_H__
+
+#include "image.h"
+#include "simd.h"
+#include "cpufeatures.h"
+
+//xorshift, the same numbers on every machine for the same seed
+class Random {
+public:
+   explicit Random(uint32_t seed) : mState(seed*2654435761u + 1) {}
+
+   uint32_t next() {
+      mState ^= mState << 13;
+      mState ^= mState >> 17;
+      mState ^= mState << 5;
+      return mState;
+   }
+   //in [low, high]
+   int range(int low, int high) {
+      return low + (int)(next() % (uint32_t)(high-low+1));
+   }
+
+private:
+   uint32_t mState;
+};
+
+inline void fillRandom(const ImageView &view, uint32_t seed) {
+   Random random(seed);
+   for(int y=0; y<view.height; ++y) {
+      uint32_t *line = view.row<uint32_t>(y);
+      for(int x=0; x<view.width; ++x)
+         line[x] = random.next();
+   }
+}
+
+inline void copyPixels(const ImageView &source, const ImageView &dest) {
+   for(int y=0; y<source.height; ++y) {
+      const uint32_t *src = source.row<uint32_t>(y);
+      uint32_t *dst = dest.row<uint32_t>(y);
+      for(int x=0; x<source.width; ++x)
+         dst[x] = src[x];
+   }
+}
+
+//runs the differential checks against reference.h for every cpu level up to the one in use,
+//returns the number of failed cases
+int runVerify(int iterations, uint32_t seed);
+
+#endif   //#ifndef __IMAGEUTILS_BENCHUTIL_H__
@@ -0,0 +1,519 @@
+
+//benchmark matrix for the resize filters, the blitter processors and the stack blur
+//
+//   imageutils_bench [--cpu level] [--quick] [--reps n] [--only text] [--csv file] [--trace file]
+//   imageutils_bench [--cpu level] --verify [iterations] [--seed n]
+//
+//every case runs on the same pseudo random pictures (fixed seed), is repeated reps times and the
+//fastest run is reported as megapixels per second and cycles per pixel (of the output). --csv
+//writes one line per case for comparing two builds. --verify runs the differential checks of
+//verify.cpp instead and exits with 1 if any variant differs from the reference, imageutils_verify
+//runs the same checks as a test of ctest. in a build with IMAGEUTILS_INSTRUMENT the stage counters
+//are printed at the end and --trace writes a chrome trace.
+//--cpu scalar|sse2|avx2|avx512 caps the kernels that are dispatched to, like IMAGEUTILS_CPU
+
+#include "ImageResize.h"
+#include "softblitter.h"
+#include "stackblur.h"
+#include "threadpool.h"
+#include "resizebatch.h"
+#include "image.h"
+#include "instrument.h"
+#include "benchutil.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Options {
+   bool quick = false;
+   int reps = 5;
+   const char *only = nullptr;
+   FILE *csv = nullptr;
+};
+static Options gOptions;
+
+struct Measurement {
+   double seconds;
+   double cycles;
+};
+
+//fastest of reps runs. setup() is called before every run and is not measured
+template<typename Setup, typename Run> static Measurement measure(const Setup &setup, const Run &run) {
+   Measurement best = { 1e30, 1e30 };
+   for(int i=0; i<gOptions.reps; ++i) {
+      setup();
+      auto start = std::chrono::steady_clock::now();
+      uint64_t startCycles = Instrument::readCycles();
+      run();
+      uint64_t endCycles = Instrument::readCycles();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if(seconds < best.seconds) {
+         best.seconds = seconds;
+         best.cycles = (double)(endCycles - startCycles);
+      }
+   }
+   return best;
+}
+
+//--only matches against "group name params size", e.g. "resize Lanczos3 ratio=0.50 1024"
+static bool selected(const std::string &name, int side) {
+   if(gOptions.only == nullptr)
+      return true;
+   char size[16];
+   sprintf(size, " %d", side);
+   return (name + size).find(gOptions.only) != std::string::npos;
+}
+
+//a text field of the csv file, quoted when it has a comma or a quote in it
+static std::string csvField(const std::string &text) {
+   if(text.find_first_of(",\"") == std::string::npos)
+      return text;
+   std::string quoted = "\"";
+   for(char c : text)
+      quoted += (c == '"') ? std::string("\"\"") : std::string(1, c);
+   return quoted + "\"";
+}
+
+static void report(const std::string &group, const std::string &name, const std::string &params,
+                   int width, int height, const Measurement &m) {
+   double pixels = (double)width*height;
+   double mpixPerSecond = pixels / m.seconds / 1e6;
+   double cyclesPerPixel = m.cycles / pixels;
+   printf("%-7s %-34s %-28s %5dx%-5d %9.2f MP/s %9.2f cyc/px\n", group.c_str(), name.c_str(), params.c_str(),
+          width, height, mpixPerSecond, cyclesPerPixel);
+   fflush(stdout);
+   if(gOptions.csv)
+      fprintf(gOptions.csv, "%s,%s,%s,%d,%d,%.4f,%.4f\n", csvField(group).c_str(), csvField(name).c_str(),
+              csvField(params).c_str(), width, height, mpixPerSecond, cyclesPerPixel);
+}
+
+static std::vector<int> sizes() {
+   if(gOptions.quick)
+      return std::vector<int>{ 256, 1024 };
+   return std::vector<int>{ 256, 1024, 2048 };
+}
+
+//=== resize
+
+template<class filter> static void benchFilter(const char *name) {
+   static const float ratios[] = { 0.25f, 0.5f, 0.75f, 1.5f, 2.0f };
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      Image input(side, side);
+      fillRandom(input, 1);
+      for(size_t r=0; r<sizeof(ratios)/sizeof(ratios[0]); ++r) {
+         if(gOptions.quick && (side > 256) && (ratios[r] > 1.0f))
+            continue;
+         int outSide = (int)(side*ratios[r]);
+         char params[64];
+         sprintf(params, "ratio=%.2f", ratios[r]);
+         if(!selected(std::string("resize ") + name + " " + params, side))
+            continue;
+         Image output(outSide, outSide);
+         Measurement m = measure([] {}, [&] { ImageResize::resample<filter>(input, output); });
+         report("resize", name, params, outSide, outSide, m);
+      }
+   }
+}
+
+static void benchResize() {
+   benchFilter<BoxFilter>("Box");
+   benchFilter<TriangleFilter>("Triangle");
+   benchFilter<HermiteFilter>("Hermite");
+   benchFilter<BellFilter>("Bell");
+   benchFilter<CubicBSplineFilter>("CubicBSpline");
+   benchFilter<Lanczos3Filter>("Lanczos3");
+   benchFilter<MitchellFilter>("Mitchell");
+   benchFilter<CosineFilter>("Cosine");
+   benchFilter<CatmullRomFilter>("CatmullRom");
+   benchFilter<QuadraticFilter>("Quadratic");
+   benchFilter<QuadraticBSplineFilter>("QuadraticBSpline");
+   benchFilter<CubicConvolutionFilter>("CubicConvolution");
+   benchFilter<Lanczos8Filter>("Lanczos8");
+}
+
+//=== blit
+
+template<class Processor> static void benchProcessor(const char *name) {
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      Image source(side, side);
+      Image dest(side, side);
+      fillRandom(source, 2);
+      for(int clipped=0; clipped<2; ++clipped) {
+         for(int scaled=0; scaled<2; ++scaled) {
+            std::string params = std::string(clipped ? "clipped" : "unclipped") + (scaled ? ",scaled" : ",unscaled");
+            if(!selected(std::string("blit ") + name + " " + params, side))
+               continue;
+            //scaled draws stretch the source by 1.5, clipped ones hang out over the top left corner
+            int w = scaled ? side*3/2 : side;
+            int offset = clipped ? -side/4 : 0;
+            if(!clipped && scaled)
+               w = side*3/4;
+            Measurement m = measure([&] { fillRandom(dest, 3); }, [&] {
+               Blitter::drawImage<uint32_t, uint32_t, Processor>(source, dest, offset, offset, w, w);
+            });
+            int visible = clipped ? (w+offset) : w;
+            if(visible > side)
+               visible = side;
+            report("blit", name, params, visible, visible, m);
+         }
+      }
+   }
+}
+
+static void benchBlit() {
+   benchProcessor<Blitter::CopyPixel>("CopyPixel");
+   benchProcessor<Blitter::ConvertGrayscaleToPixel<8> >("ConvertGrayscaleToPixel<8>");
+   benchProcessor<Blitter::BlendPixelFullTransparence>("BlendPixelFullTransparence");
+   benchProcessor<Blitter::BlendPixel1BitTransparence>("BlendPixel1BitTransparence");
+}
+
+//=== blur
+
+static void benchBlur() {
+   static const int radii[] = { 2, 8, 32, 128, 254 };
+   ThreadPool &pool = ThreadPool::getShared();
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      Image source(side, side);
+      Image work(side, side);
+      fillRandom(source, 4);
+      auto setup = [&] {
+         for(int y=0; y<side; ++y)
+            memcpy(work.row<uint32_t>(y), source.row<uint32_t>(y), side*sizeof(uint32_t));
+      };
+      uint32_t *pixels = (uint32_t*)work.data();
+      int pitch = work.view().pitch();
+      for(size_t r=0; r<sizeof(radii)/sizeof(radii[0]); ++r) {
+         int radius = radii[r];
+         char params[64];
+         sprintf(params, "radius=%d", radius);
+         if(selected(std::string("blur dispatched ") + params, side))
+            report("blur", "dispatched", params, side, side, measure(setup, [&] {
+               Stackblur::blurFast(pixels, pitch, 0, 0, side, side, radius, radius);
+            }));
+         if(selected(std::string("blur scalar ") + params, side))
+            report("blur", "scalar", params, side, side, measure(setup, [&] {
+               Stackblur::blur(pixels, pitch, 0, 0, side, side, radius, radius);
+            }));
+#ifdef IMAGEUTILS_SSE2
+         if(selected(std::string("blur sse2 ") + params, side))
+            report("blur", "sse2", params, side, side, measure(setup, [&] {
+               Stackblur::blurSSE2(pixels, pitch, 0, 0, side, side, radius, radius);
+            }));
+#endif
+#ifdef IMAGEUTILS_AVX2
+         if((CpuFeatures::getLevel() >= CpuLevelAVX2) && selected(std::string("blur avx2 ") + params, side))
+            report("blur", "avx2", params, side, side, measure(setup, [&] {
+               Stackblur::blurAVX2(pixels, pitch, 0, 0, side, side, radius, radius);
+            }));
+#endif
+         char threads[64];
+         sprintf(threads, "parallel x%d", pool.getNumberThreads());
+         if(selected(std::string("blur ") + threads + " " + params, side))
+            report("blur", threads, params, side, side, measure(setup, [&] {
+               Stackblur::blurParallel(pool, pixels, pitch, 0, 0, side, side, radius, radius);
+            }));
+         if(selected(std::string("blur large ") + params, side))
+            report("blur", "large", params, side, side, measure(setup, [&] {
+               Stackblur::blurLarge(pixels, pitch, 0, 0, side, side, radius*4, radius*4);
+            }));
+      }
+   }
+}
+
+//=== scheduling
+
+//one picture split into bands against several pictures at once, every one of them split again
+static void benchParallel() {
+   ThreadPool &pool = ThreadPool::getShared();
+   enum { NumberPictures = 8 };
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      int outSide = side/2;
+      Image input(side, side);
+      fillRandom(input, 5);
+      std::vector<Image> outputs;
+      for(int i=0; i<NumberPictures; ++i)
+         outputs.push_back(Image(outSide, outSide));
+      char threads[64];
+      sprintf(threads, "x%d", pool.getNumberThreads());
+      if(selected(std::string("pool resize Lanczos3 bands ") + threads, side))
+         report("pool", std::string("resize Lanczos3 bands ") + threads, "ratio=0.50", outSide, outSide,
+                measure([] {}, [&] { ImageResize::resample<Lanczos3Filter>(pool, input, outputs[0]); }));
+      if(selected(std::string("pool resize Lanczos3 nested ") + threads, side)) {
+         Measurement m = measure([] {}, [&] {
+            pool.run(NumberPictures, [&](int i) { ImageResize::resample<Lanczos3Filter>(pool, input, outputs[i]); });
+         });
+         report("pool", std::string("resize Lanczos3 nested ") + threads, "ratio=0.50,pictures=8", outSide,
+                outSide*NumberPictures, m);
+      }
+   }
+}
+
+//=== tiles
+
+//a 256x256 tile of a big upscale against the whole upscale
+static void benchRegion() {
+   enum { TileSide = 256 };
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      int outSide = side*4;
+      Image input(side, side);
+      Image tile(TileSide, TileSide);
+      fillRandom(input, 7);
+      if(selected("region Lanczos3 tile", side))
+         report("region", "Lanczos3 tile", "ratio=4.00", TileSide, TileSide, measure([] {}, [&] {
+            ImageResize::resampleRegion<Lanczos3Filter>(input, outSide, outSide, outSide/2, outSide/2, tile);
+         }));
+      if(!gOptions.quick && selected("region Lanczos3 full", side)) {
+         Image output(outSide, outSide);
+         report("region", "Lanczos3 full", "ratio=4.00", outSide, outSide, measure([] {}, [&] {
+            ImageResize::resample<Lanczos3Filter>(input, output);
+         }));
+      }
+   }
+}
+
+//=== out of core
+
+//the strip resample between two pictures in memory, with a budget of a few megabytes against one
+//for the whole picture
+static void benchStrips() {
+   static const size_t budgets[] = { 1 << 20, 8 << 20, (size_t)1 << 31 };
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s]*2;
+      int outSide = side/3;
+      Image input(side, side);
+      Image output(outSide, outSide);
+      fillRandom(input, 8);
+      ViewRows source(input);
+      ViewRows sink(output);
+      for(size_t b=0; b<sizeof(budgets)/sizeof(budgets[0]); ++b) {
+         char params[64];
+         sprintf(params, "ratio=0.33,budget=%dk", (int)eastl::min(budgets[b] >> 10, (size_t)0x7fffffff));
+         if(!selected(std::string("strips Lanczos3 ") + params, side))
+            continue;
+         report("strips", "Lanczos3", params, outSide, outSide, measure([] {}, [&] {
+            ImageResize::resampleStrips(ResizeFilterLanczos3, source, sink, budgets[b]);
+         }));
+      }
+   }
+}
+
+//=== linear light
+
+//the same cases as the resize group for a few filters, to compare with the sRGB resample
+static void benchLinear() {
+   static const ResizeFilter filters[] = { ResizeFilterTriangle, ResizeFilterLanczos3 };
+   static const float ratios[] = { 0.25f, 0.5f, 2.0f };
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      Image input(side, side);
+      fillRandom(input, 1);
+      for(size_t f=0; f<sizeof(filters)/sizeof(filters[0]); ++f) {
+         for(size_t r=0; r<sizeof(ratios)/sizeof(ratios[0]); ++r) {
+            if(gOptions.quick && (side > 256) && (ratios[r] > 1.0f))
+               continue;
+            int outSide = (int)(side*ratios[r]);
+            const char *name = ImageResize::getFilterName(filters[f]);
+            char params[64];
+            sprintf(params, "ratio=%.2f", ratios[r]);
+            if(!selected(std::string("linear ") + name + " " + params, side))
+               continue;
+            Image output(outSide, outSide);
+            report("linear", name, params, outSide, outSide, measure([] {}, [&] {
+               ImageResize::resampleLinear(filters[f], input, output);
+            }));
+         }
+      }
+   }
+}
+
+//=== order of the passes
+
+//resample() with the order of the cost model or with the horizontal pass forced first
+static void resampleOrdered(ResizeFilter filter, const ImageView &input, const ImageView &output, bool chosen) {
+   ImageResize::ContributorEntry *horizontal = new ImageResize::ContributorEntry[output.width];
+   ImageResize::ContributorEntry *vertical = new ImageResize::ContributorEntry[output.height];
+   ImageResize::calcContributors(filter, horizontal, input.width, output.width, true);
+   ImageResize::calcContributors(filter, vertical, input.height, output.height, false);
+   bool verticalFirst = chosen && ImageResize::isVerticalFirst(input.width, input.height, output.width, output.height,
+                                                               filter);
+   SerialExecutor serial;
+   ImageResize::resamplePasses(serial, input, horizontal, vertical, verticalFirst, output);
+   ImageResize::freeContributors(horizontal, output.width);
+   ImageResize::freeContributors(vertical, output.height);
+   delete[] horizontal;
+   delete[] vertical;
+}
+
+//different scales on the two axes, where the order matters
+static void benchOrder() {
+   static const ResizeFilter filters[] = { ResizeFilterTriangle, ResizeFilterLanczos3 };
+   static const float ratios[][2] = { { 4.0f, 1.0f }, { 1.0f, 0.25f }, { 2.0f, 0.5f } };
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s];
+      Image input(side, side);
+      fillRandom(input, 1);
+      for(size_t f=0; f<sizeof(filters)/sizeof(filters[0]); ++f) {
+         for(size_t r=0; r<sizeof(ratios)/sizeof(ratios[0]); ++r) {
+            if(gOptions.quick && (side > 256))
+               continue;
+            int outWidth = (int)(side*ratios[r][0]);
+            int outHeight = (int)(side*ratios[r][1]);
+            char params[64];
+            sprintf(params, "ratio=%.2fx%.2f", ratios[r][0], ratios[r][1]);
+            std::string name = ImageResize::getFilterName(filters[f]);
+            if(!selected(std::string("order ") + name + " " + params, side))
+               continue;
+            Image output(outWidth, outHeight);
+            report("order", name + " horizontal first", params, outWidth, outHeight, measure([] {}, [&] {
+               resampleOrdered(filters[f], input, output, false);
+            }));
+            report("order", name + " cost model", params, outWidth, outHeight, measure([] {}, [&] {
+               resampleOrdered(filters[f], input, output, true);
+            }));
+         }
+      }
+   }
+}
+
+//=== thumbnails
+
+//the usual set of thumbnail sizes of one picture, one resample() per size against one batch.
+//reported per pixel of the source
+static void benchBatch() {
+   static const int widths[] = { 1024, 640, 320, 256, 160, 64 };
+   enum { NumberTargets = sizeof(widths)/sizeof(widths[0]) };
+   ThreadPool &pool = ThreadPool::getShared();
+   ResizeBatch batch;
+   std::vector<int> sides = sizes();
+   for(size_t s=0; s<sides.size(); ++s) {
+      int side = sides[s]*2;
+      Image input(side, side*3/4);
+      fillRandom(input, 6);
+      std::vector<Image> outputs;
+      ResizeBatch::Target targets[NumberTargets];
+      for(int t=0; t<NumberTargets; ++t) {
+         int width = eastl::min(widths[t], side/2);
+         outputs.push_back(Image(width, width*3/4));
+         targets[t].output = outputs.back().view();
+         targets[t].filter = ResizeFilterLanczos3;
+      }
+      if(selected("batch Lanczos3 single", side))
+         report("batch", "Lanczos3 single", "targets=6", side, side*3/4, measure([] {}, [&] {
+            for(int t=0; t<NumberTargets; ++t)
+               ImageResize::resample<Lanczos3Filter>(pool, input, targets[t].output);
+         }));
+      for(int pyramid=0; pyramid<2; ++pyramid) {
+         const char *name = pyramid ? "Lanczos3 batch pyramid" : "Lanczos3 batch";
+         if(!selected(std::string("batch ") + name, side))
+            continue;
+         batch.setUsePyramid(pyramid != 0);
+         report("batch", name, "targets=6", side, side*3/4, measure([] {}, [&] {
+            batch.resample(pool, input, targets, NumberTargets);
+         }));
+      }
+   }
+}
+
+static void printInstrumentation() {
+#ifdef IMAGEUTILS_INSTRUMENT
+   Instrument::Snapshot snapshot = Instrument::snapshot();
+   printf("\n%-24s %12s %14s %10s\n", "stage", "calls", "pixels", "cyc/px");
+   for(int i=0; i<Instrument::NumberStages; ++i) {
+      const Instrument::Counters &counters = snapshot.stages[i];
+      if(counters.calls == 0)
+         continue;
+      double cyclesPerPixel = counters.pixels ? (double)counters.cycles / (double)counters.pixels : 0.0;
+      printf("%-24s %12llu %14llu %10.2f\n", Instrument::getStageName((Instrument::Stage)i),
+             (unsigned long long)counters.calls, (unsigned long long)counters.pixels, cyclesPerPixel);
+   }
+#endif
+}
+
+int main(int argc, char **argv) {
+   const char *csvName = nullptr;
+   const char *traceName = nullptr;
+   int verifyIterations = 0;
+   uint32_t seed = 1;
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i], "--verify")) {
+         verifyIterations = 200;
+         if((i+1 < argc) && (argv[i+1][0] != '-'))
+            verifyIterations = atoi(argv[++i]);
+      } else if(!strcmp(argv[i], "--seed") && (i+1 < argc))
+         seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+      else if(!strcmp(argv[i], "--cpu") && (i+1 < argc)) {
+         CpuLevel level;
+         if(!CpuFeatures::parseLevel(argv[++i], level)) {
+            fprintf(stderr, "unknown cpu level %s\n", argv[i]);
+            return 1;
+         }
+         CpuFeatures::setLevel(level);
+      } else if(!strcmp(argv[i], "--quick"))
+         gOptions.quick = true;
+      else if(!strcmp(argv[i], "--reps") && (i+1 < argc))
+         gOptions.reps = atoi(argv[++i]);
+      else if(!strcmp(argv[i], "--only") && (i+1 < argc))
+         gOptions.only = argv[++i];
+      else if(!strcmp(argv[i], "--csv") && (i+1 < argc))
+         csvName = argv[++i];
+      else if(!strcmp(argv[i], "--trace") && (i+1 < argc))
+         traceName = argv[++i];
+      else {
+         fprintf(stderr, "usage: %s [--cpu level] [--quick] [--reps n] [--only text] [--csv file] [--trace file]\n"
+                         "       %s [--cpu level] --verify [iterations] [--seed n]\n", argv[0], argv[0]);
+         return 1;
+      }
+   }
+   printf("cpu level %s (detected %s)\n", CpuFeatures::getLevelName(CpuFeatures::getLevel()),
+          CpuFeatures::getLevelName(CpuFeatures::getDetectedLevel()));
+   if(verifyIterations > 0)
+      return (runVerify(verifyIterations, seed) == 0) ? 0 : 1;
+   if(gOptions.reps < 1)
+      gOptions.reps = 1;
+   if(csvName) {
+      gOptions.csv = fopen(csvName, "w");
+      if(!gOptions.csv) {
+         fprintf(stderr, "can't open %s\n", csvName);
+         return 1;
+      }
+      fprintf(gOptions.csv, "group,name,params,width,height,mpix_per_s,cycles_per_pixel\n");
+   }
+
+   if(traceName)
+      Instrument::startTrace(traceName);
+   Instrument::reset();
+
+   benchResize();
+   benchBlit();
+   benchBlur();
+   benchParallel();
+   benchBatch();
+   benchRegion();
+   benchStrips();
+   benchLinear();
+   benchOrder();
+
+   Instrument::stopTrace();
+   printInstrumentation();
+
+   if(gOptions.csv)
+      fclose(gOptions.csv);
+   return 0;
+}
@@ -0,0 +1,870 @@
+
+//differential checks: every faster variant of resize, blit and blur runs on random sizes, ratios,
+//positions and radii next to the scalar code of reference.h, once for each cpu level. the file
+//formats are written and read back once. a failing case prints the biggest channel error and the
+//first differing pixel
+
+#include "reference.h"
+#include "threadpool.h"
+#include "resizebatch.h"
+#include "imagefile.h"
+#include "benchutil.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct VerifyStats {
+   int cases;
+   int failures;
+};
+
+static bool check(VerifyStats &stats, const char *variant, const std::string &setup,
+                  const ImageView &expected, const ImageView &actual, int tolerance = 0) {
+   stats.cases++;
+   Reference::Difference diff = Reference::compare(expected, actual);
+   if(diff.maxError <= tolerance)
+      return true;
+   stats.failures++;
+   printf("FAIL %-28s %s: max error %d, %d of %dx%d pixels differ, first at (%d,%d) expected 0x%08x got 0x%08x\n",
+          variant, setup.c_str(), diff.maxError, diff.numberDifferent, expected.width, expected.height,
+          diff.firstX, diff.firstY, diff.expected, diff.actual);
+   return false;
+}
+
+//a failed check that has no pictures to compare
+static void fail(VerifyStats &stats, const char *variant, const std::string &setup, const char *what) {
+   stats.cases++;
+   stats.failures++;
+   printf("FAIL %-28s %s: %s\n", variant, setup.c_str(), what);
+}
+
+//biggest channel error of the linear light resample against the double reference
+static const int LinearTolerance = 1;
+//biggest channel error of blurLarge() on stripes of one color, the blur and the resizes round down
+static const int LargeStripeTolerance = 1;
+
+//biggest channel error between the two orders of the passes, both truncate once between the
+//passes and once at the end. filters with negative lobes never go vertical first, they have to
+//match the original order exactly
+static const int OrderTolerance = 2;
+
+static void summary(const char *group, const VerifyStats &stats) {
+   printf("%-8s %-8s %6d cases, %d failed\n", CpuFeatures::getLevelName(CpuFeatures::getLevel()), group,
+          stats.cases, stats.failures);
+}
+
+//a picture with a random stride, so that no variant can rely on rows without gaps
+static Image randomImage(Random &random, int width, int height) {
+   Image image(width + random.range(0, 20), height);
+   fillRandom(image, random.next());
+   return image;
+}
+
+static ImageView cropped(const Image &image, int width, int height) {
+   return image.view().crop(0, 0, width, height);
+}
+
+//=== resize
+
+//the reference in the order of the passes ImageResize takes for these sizes
+template<class filter> static void orderedReference(const ImageView &input, const ImageView &output) {
+   if(ImageResize::isVerticalFirst<filter>(input.width, input.height, output.width, output.height))
+      Reference::resampleVerticalFirst<filter>(input, output);
+   else
+      Reference::resample<filter>(input, output);
+}
+
+template<class filter> static void verifyFilter(VerifyStats &stats, Random &random, ThreadPool &pool, const char *name) {
+   int inputWidth = random.range(1, 160);
+   int inputHeight = random.range(1, 160);
+   int outputWidth = random.range(1, 160);
+   int outputHeight = random.range(1, 160);
+   Image inputImage = randomImage(random, inputWidth, inputHeight);
+   ImageView input = cropped(inputImage, inputWidth, inputHeight);
+   Image expected(outputWidth, outputHeight);
+   Image actual(outputWidth, outputHeight);
+
+   char setup[128];
+   sprintf(setup, "%dx%d -> %dx%d", inputWidth, inputHeight, outputWidth, outputHeight);
+
+   orderedReference<filter>(input, expected);
+   ImageResize::resample<filter>(input, actual);
+   check(stats, (std::string("resample ") + name).c_str(), setup, expected, actual);
+   ImageResize::resample<filter>(pool, input, actual);
+   check(stats, (std::string("resample parallel ") + name).c_str(), setup, expected, actual);
+
+   //against the original order, whatever order was taken. the shape of the picture may only move
+   //filters without negative lobes, and only by a step or two
+   Image original(outputWidth, outputHeight);
+   Reference::resample<filter>(input, original);
+   check(stats, (std::string("resample order ") + name).c_str(), setup, original, actual,
+         ImageResize::hasNegativeLobes<filter>() ? 0 : OrderTolerance);
+
+   //a random tile of the same resample, on a picture with a stride of its own
+   int tileX = random.range(0, outputWidth-1);
+   int tileY = random.range(0, outputHeight-1);
+   int tileWidth = random.range(1, outputWidth-tileX);
+   int tileHeight = random.range(1, outputHeight-tileY);
+   Image tileImage = randomImage(random, tileWidth, tileHeight);
+   ImageView tile = cropped(tileImage, tileWidth, tileHeight);
+   ImageResize::resampleRegion<filter>(input, outputWidth, outputHeight, tileX, tileY, tile);
+   sprintf(setup, "%dx%d -> %dx%d tile %dx%d at (%d,%d)", inputWidth, inputHeight, outputWidth, outputHeight,
+           tileWidth, tileHeight, tileX, tileY);
+   check(stats, (std::string("resampleRegion ") + name).c_str(), setup,
+         expected.view().crop(tileX, tileY, tileWidth, tileHeight), tile);
+}
+
+template<class filter> static void referenceResample(const ImageView &input, const ImageView &output, bool linear) {
+   if(linear)
+      Reference::resampleLinear<filter>(input, output);
+   else
+      orderedReference<filter>(input, output);
+}
+
+static void referenceResample(ResizeFilter filter, const ImageView &input, const ImageView &output,
+                              bool linear = false) {
+   switch(filter) {
+      case ResizeFilterBox:              referenceResample<BoxFilter>(input, output, linear); break;
+      case ResizeFilterTriangle:         referenceResample<TriangleFilter>(input, output, linear); break;
+      case ResizeFilterHermite:          referenceResample<HermiteFilter>(input, output, linear); break;
+      case ResizeFilterBell:             referenceResample<BellFilter>(input, output, linear); break;
+      case ResizeFilterCubicBSpline:     referenceResample<CubicBSplineFilter>(input, output, linear); break;
+      case ResizeFilterLanczos3:         referenceResample<Lanczos3Filter>(input, output, linear); break;
+      case ResizeFilterMitchell:         referenceResample<MitchellFilter>(input, output, linear); break;
+      case ResizeFilterCosine:           referenceResample<CosineFilter>(input, output, linear); break;
+      case ResizeFilterCatmullRom:       referenceResample<CatmullRomFilter>(input, output, linear); break;
+      case ResizeFilterQuadratic:        referenceResample<QuadraticFilter>(input, output, linear); break;
+      case ResizeFilterQuadraticBSpline: referenceResample<QuadraticBSplineFilter>(input, output, linear); break;
+      case ResizeFilterCubicConvolution: referenceResample<CubicConvolutionFilter>(input, output, linear); break;
+      default:                           referenceResample<Lanczos8Filter>(input, output, linear); break;
+   }
+}
+
+//a batch of targets, some of them sharing width and filter, against one reference resample each.
+//pyramid targets are compared with a resample of the halved source
+static void verifyBatch(VerifyStats &stats, Random &random, ThreadPool &pool, ResizeBatch &batch) {
+   enum { MaxTargets = 6 };
+   int inputWidth = random.range(1, 300);
+   int inputHeight = random.range(1, 300);
+   Image inputImage = randomImage(random, inputWidth, inputHeight);
+   ImageView input = cropped(inputImage, inputWidth, inputHeight);
+   batch.setUsePyramid(random.range(0, 1) != 0);
+
+   int numberTargets = random.range(1, MaxTargets);
+   Image outputs[MaxTargets];
+   ResizeBatch::Target targets[MaxTargets];
+   for(int t=0; t<numberTargets; ++t) {
+      bool shared = (t > 0) && (random.range(0, 2) == 0);
+      int width = shared ? targets[t-1].output.width : random.range(1, 160);
+      outputs[t].create(width, random.range(1, 160));
+      targets[t].output = outputs[t].view();
+      targets[t].filter = shared ? targets[t-1].filter : (ResizeFilter)random.range(0, NumberResizeFilters-1);
+   }
+   //now and then an empty target in between, the others don't notice it
+   if((numberTargets < MaxTargets) && (random.range(0, 3) == 0)) {
+      targets[numberTargets].output = ImageView();
+      targets[numberTargets].filter = ResizeFilterBox;
+      numberTargets++;
+   }
+   batch.resample(pool, input, targets, numberTargets);
+
+   for(int t=0; t<numberTargets; ++t) {
+      const ImageView &output = targets[t].output;
+      if(output.isEmpty())
+         continue;
+      int level = batch.getUsePyramid() ? ResizeBatch::getLevel(inputWidth, inputHeight, output.width, output.height) : 0;
+      Image levelImage;
+      ImageView levelView = input;
+      for(int l=0; l<level; ++l) {
+         Image half((levelView.width+1)/2, (levelView.height+1)/2);
+         ImageResize::halve(levelView, half);
+         levelImage = std::move(half);
+         levelView = levelImage.view();
+      }
+      Image expected(output.width, output.height);
+      referenceResample(targets[t].filter, levelView, expected);
+
+      char setup[128];
+      sprintf(setup, "%dx%d -> %dx%d level %d", inputWidth, inputHeight, output.width, output.height, level);
+      check(stats, (std::string("batch ") + ImageResize::getFilterName(targets[t].filter)).c_str(), setup,
+            expected, output);
+   }
+
+   //a target without pixels ends the pyramid at 1x1
+   int levels = 0;
+   for(int w=inputWidth, h=inputHeight; (w > 1) || (h > 1); w=(w+1)/2, h=(h+1)/2)
+      levels++;
+   char setup[128];
+   sprintf(setup, "%dx%d -> 0x0", inputWidth, inputHeight);
+   if(ResizeBatch::getLevel(inputWidth, inputHeight, 0, 0) != levels)
+      fail(stats, "batch getLevel", setup, "not the 1x1 level");
+   else
+      stats.cases++;
+}
+
+//the strip resample with budgets from a single row up to the whole picture against the reference
+static void verifyStrips(VerifyStats &stats, Random &random, ThreadPool &pool) {
+   int inputWidth = random.range(1, 200);
+   int inputHeight = random.range(1, 300);
+   int outputWidth = random.range(1, 200);
+   int outputHeight = random.range(1, 300);
+   ResizeFilter filter = (ResizeFilter)random.range(0, NumberResizeFilters-1);
+   size_t budget = (size_t)random.range(1, inputHeight)*outputWidth*sizeof(uint32_t);
+   Image inputImage = randomImage(random, inputWidth, inputHeight);
+   ImageView input = cropped(inputImage, inputWidth, inputHeight);
+   Image expected(outputWidth, outputHeight);
+   Image actual(outputWidth, outputHeight);
+   referenceResample(filter, input, expected);
+
+   ViewRows source(input);
+   ViewRows sink(actual);
+   ImageResize::resampleStrips(pool, filter, source, sink, budget);
+
+   char setup[128];
+   sprintf(setup, "%dx%d -> %dx%d budget %d rows", inputWidth, inputHeight, outputWidth, outputHeight,
+           (int)(budget / (outputWidth*sizeof(uint32_t))));
+   check(stats, (std::string("resampleStrips ") + ImageResize::getFilterName(filter)).c_str(), setup, expected, actual);
+}
+
+//=== files
+
+//a path in the temporary directory that other runs don't use at the same time
+static std::string tempPath(Random &random, const char *extension) {
+   const char *directory = getenv("TMPDIR");
+   if(!directory)
+      directory = getenv("TEMP");
+#ifdef _WIN32
+   if(!directory)
+      directory = ".";
+#else
+   if(!directory)
+      directory = "/tmp";
+#endif
+   uint32_t unique = random.next() ^ (uint32_t)std::chrono::steady_clock::now().time_since_epoch().count();
+   char name[64];
+   sprintf(name, "/imageutils_verify_%08x", unique);
+   return std::string(directory) + name + extension;
+}
+
+//a tga file with the bottom row first, MappedImage and ImageWriter only write them top down
+static bool saveBottomUpTGA(const char *path, const ImageView &view, int channels) {
+   ImageFileLayout layout = ImageFileLayout::make(ImageFileTGA, view.width, view.height, channels);
+   uint8_t header[ImageFileLayout::MaxHeaderSize];
+   int headerSize = layout.writeHeader(header);
+   header[17] &= ~0x20;
+   FILE *file = fopen(path, "wb");
+   if(!file)
+      return false;
+   bool written = fwrite(header, 1, headerSize, file) == (size_t)headerSize;
+   std::vector<uint8_t> row((size_t)layout.getRowBytes());
+   for(int y=view.height-1; (y >= 0) && written; --y) {
+      layout.packRow(view.row<uint32_t>(y), row.data());
+      written = fwrite(row.data(), 1, row.size(), file) == row.size();
+   }
+   return (fclose(file) == 0) && written;
+}
+
+//the rows of a mapped file into a picture
+static void readRows(const MappedImage &file, Image &image) {
+   image.create(file.getWidth(), file.getHeight());
+   ImageView view = image.view();
+   for(int y=0; y<view.height; ++y) {
+      const uint32_t *row = file.readRow(y, view.row<uint32_t>(y));
+      if(row != view.row<uint32_t>(y))
+         memcpy(view.row<uint32_t>(y), row, (size_t)view.width*4);
+   }
+}
+
+//what a file of the channels keeps of a picture: without alpha it reads back opaque
+static void keepChannels(const ImageView &view, int channels) {
+   for(int y=0; (y<view.height) && (channels == 3); ++y) {
+      uint32_t *row = view.row<uint32_t>(y);
+      for(int x=0; x<view.width; ++x)
+         row[x] |= 0xff000000;
+   }
+}
+
+//the strip resample from file to file with a budget of a few rows, so that both files are released
+//strip by strip while they are used. a bottom up tga source releases its rows from the end of the
+//file. the released rows are read and written once more afterwards, which has to map them in again
+static void verifyMappedStrips(VerifyStats &stats, Random &random, ThreadPool &pool) {
+   enum { SourceRaw, SourcePPM, SourceTGA, SourceBottomUpTGA };
+   static const ImageFileFormat sinkFormats[] = { ImageFileRaw, ImageFilePPM, ImageFilePAM, ImageFileTGA };
+   int inputWidth = random.range(1, 300);
+   int inputHeight = random.range(1, 300);
+   int outputWidth = random.range(1, 300);
+   int outputHeight = random.range(1, 300);
+   ResizeFilter filter = (ResizeFilter)random.range(0, NumberResizeFilters-1);
+   int source = random.range(SourceRaw, SourceBottomUpTGA);
+   int sourceChannels = (source == SourceRaw) ? 4 : ((source == SourcePPM) ? 3 : random.range(3, 4));
+   ImageFileFormat sinkFormat = sinkFormats[random.range(0, 3)];
+   int sinkChannels = ImageFileLayout::make(sinkFormat, 1, 1, random.range(3, 4)).channels;
+   size_t budget = (size_t)random.range(1, 8)*eastl::max(inputWidth, outputWidth)*sizeof(uint32_t);
+
+   Image input(inputWidth, inputHeight);
+   fillRandom(input, random.next());
+   keepChannels(input, sourceChannels);
+   Image expected(outputWidth, outputHeight);
+   referenceResample(filter, input, expected);
+
+   static const char *sourceNames[] = { "raw", "ppm", "tga", "bottom up tga" };
+   char setup[160];
+   sprintf(setup, "%s %d -> %s %d, %dx%d -> %dx%d budget %d bytes", sourceNames[source], sourceChannels,
+           ImageFileLayout::getExtension(sinkFormat)+1, sinkChannels, inputWidth, inputHeight, outputWidth,
+           outputHeight, (int)budget);
+   std::string name = std::string("mapped strips ") + ImageResize::getFilterName(filter);
+
+   std::string inputPath = tempPath(random, (source == SourceRaw) ? ".raw" : ((source == SourcePPM) ? ".ppm" : ".tga"));
+   std::string outputPath = tempPath(random, ImageFileLayout::getExtension(sinkFormat));
+   MappedImage inputFile, outputFile;
+   bool opened = (source == SourceBottomUpTGA) ? saveBottomUpTGA(inputPath.c_str(), input, sourceChannels) :
+                                                 MappedImage::save(inputPath.c_str(), input, sourceChannels);
+   opened = opened && ((source == SourceRaw) ? inputFile.openRaw(inputPath.c_str(), inputWidth, inputHeight) :
+                                               inputFile.open(inputPath.c_str()));
+   opened = opened && (inputFile.getLayout().bottomUp == (source == SourceBottomUpTGA)) &&
+            outputFile.create(outputPath.c_str(), sinkFormat, outputWidth, outputHeight, sinkChannels);
+   if(!opened) {
+      stats.cases++;
+      stats.failures++;
+      printf("FAIL %-28s %s: can't write %s or %s\n", name.c_str(), setup, inputPath.c_str(), outputPath.c_str());
+   } else {
+      ImageResize::resampleStrips(pool, filter, inputFile, outputFile, budget);
+
+      Image reread;
+      readRows(inputFile, reread);
+      check(stats, "mapped reread", setup, input, reread);
+
+      //the first row again after everything is released, inverted
+      std::vector<uint32_t> buffer(outputWidth);
+      uint32_t *expectedRow = expected.view().row<uint32_t>(0);
+      uint32_t *row = outputFile.beginRow(0, buffer.data());
+      for(int x=0; x<outputWidth; ++x)
+         row[x] = expectedRow[x] ^= 0x00ffffff;
+      outputFile.endRow(0, row);
+      outputFile.close();
+
+      Image actual;
+      opened = (sinkFormat == ImageFileRaw) ? outputFile.openRaw(outputPath.c_str(), outputWidth, outputHeight) :
+                                              outputFile.open(outputPath.c_str());
+      if(opened)
+         readRows(outputFile, actual);
+      else
+         actual.create(outputWidth, outputHeight);
+      keepChannels(expected, sinkChannels);
+      check(stats, name.c_str(), setup, expected, actual);
+   }
+   inputFile.close();
+   outputFile.close();
+   remove(inputPath.c_str());
+   remove(outputPath.c_str());
+}
+
+//linear light against the double reference with a tolerance for the fixed point, and against the
+//scalar kernels down to the bit
+static void verifyLinear(VerifyStats &stats, Random &random, ThreadPool &pool) {
+   int inputWidth = random.range(1, 160);
+   int inputHeight = random.range(1, 160);
+   int outputWidth = random.range(1, 160);
+   int outputHeight = random.range(1, 160);
+   ResizeFilter filter = (ResizeFilter)random.range(0, NumberResizeFilters-1);
+   Image inputImage = randomImage(random, inputWidth, inputHeight);
+   ImageView input = cropped(inputImage, inputWidth, inputHeight);
+   Image expected(outputWidth, outputHeight);
+   Image scalar(outputWidth, outputHeight);
+   Image actual(outputWidth, outputHeight);
+   referenceResample(filter, input, expected, true);
+
+   CpuLevel level = CpuFeatures::getLevel();
+   CpuFeatures::setLevel(CpuLevelScalar);
+   ImageResize::resampleLinear(filter, input, scalar);
+   CpuFeatures::setLevel(level);
+   ImageResize::resampleLinear(pool, filter, input, actual);
+
+   char setup[128];
+   sprintf(setup, "%dx%d -> %dx%d", inputWidth, inputHeight, outputWidth, outputHeight);
+   std::string name = std::string("resampleLinear ") + ImageResize::getFilterName(filter);
+   check(stats, name.c_str(), setup, expected, actual, LinearTolerance);
+   check(stats, (name + " scalar").c_str(), setup, scalar, actual);
+}
+
+static int verifyResize(Random &random, ThreadPool &pool, int iterations) {
+   VerifyStats stats = { 0, 0 };
+   for(int i=0; i<iterations; ++i) {
+      switch(random.range(0, 12)) {
+         case 0:  verifyFilter<BoxFilter>(stats, random, pool, "Box"); break;
+         case 1:  verifyFilter<TriangleFilter>(stats, random, pool, "Triangle"); break;
+         case 2:  verifyFilter<HermiteFilter>(stats, random, pool, "Hermite"); break;
+         case 3:  verifyFilter<BellFilter>(stats, random, pool, "Bell"); break;
+         case 4:  verifyFilter<CubicBSplineFilter>(stats, random, pool, "CubicBSpline"); break;
+         case 5:  verifyFilter<Lanczos3Filter>(stats, random, pool, "Lanczos3"); break;
+         case 6:  verifyFilter<MitchellFilter>(stats, random, pool, "Mitchell"); break;
+         case 7:  verifyFilter<CosineFilter>(stats, random, pool, "Cosine"); break;
+         case 8:  verifyFilter<CatmullRomFilter>(stats, random, pool, "CatmullRom"); break;
+         case 9:  verifyFilter<QuadraticFilter>(stats, random, pool, "Quadratic"); break;
+         case 10: verifyFilter<QuadraticBSplineFilter>(stats, random, pool, "QuadraticBSpline"); break;
+         case 11: verifyFilter<CubicConvolutionFilter>(stats, random, pool, "CubicConvolution"); break;
+         default: verifyFilter<Lanczos8Filter>(stats, random, pool, "Lanczos8"); break;
+      }
+   }
+   //one batch object for all of them, so the plans are reused between the calls
+   ResizeBatch batch;
+   for(int i=0; i<iterations; ++i)
+      verifyBatch(stats, random, pool, batch);
+   for(int i=0; i<iterations; ++i)
+      verifyStrips(stats, random, pool);
+   for(int i=0; i<iterations; ++i)
+      verifyMappedStrips(stats, random, pool);
+   for(int i=0; i<iterations; ++i)
+      verifyLinear(stats, random, pool);
+   summary("resize", stats);
+   return stats.failures;
+}
+
+//=== file formats
+
+//a picture in memory for ImageReader and ImageWriter
+struct MemoryStream {
+   std::vector<uint8_t> data;
+   size_t position;
+};
+
+static size_t readMemory(void *context, void *data, size_t size) {
+   MemoryStream &stream = *(MemoryStream*)context;
+   size = eastl::min(size, stream.data.size() - stream.position);
+   memcpy(data, &stream.data[stream.position], size);
+   stream.position += size;
+   return size;
+}
+
+static size_t writeMemory(void *context, const void *data, size_t size) {
+   MemoryStream &stream = *(MemoryStream*)context;
+   stream.data.insert(stream.data.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+   return size;
+}
+
+static bool readBytes(const std::string &path, std::vector<uint8_t> &bytes) {
+   FILE *file = fopen(path.c_str(), "rb");
+   if(!file)
+      return false;
+   bytes.clear();
+   uint8_t block[4096];
+   size_t size;
+   while((size = fread(block, 1, sizeof(block), file)) > 0)
+      bytes.insert(bytes.end(), block, block+size);
+   fclose(file);
+   return true;
+}
+
+static bool sameLayout(const ImageFileLayout &layout, ImageFileFormat format, int width, int height, int channels,
+                       bool bottomUp) {
+   return (layout.format == format) && (layout.width == width) && (layout.height == height) &&
+          (layout.channels == channels) && (layout.bottomUp == bottomUp);
+}
+
+//a random picture in one of the formats written by MappedImage::save() and ImageWriter, the tga
+//bottom up as well, and read back by MappedImage and ImageReader. the two writers give the same bytes
+static void verifyFormat(VerifyStats &stats, Random &random) {
+   static const struct {
+      ImageFileFormat format;
+      int channels;
+      bool bottomUp;
+      const char *name;
+   } formats[] = {
+      { ImageFilePPM, 3, false, "ppm" },
+      { ImageFilePAM, 3, false, "pam 3" },
+      { ImageFilePAM, 4, false, "pam 4" },
+      { ImageFileTGA, 3, false, "tga 3" },
+      { ImageFileTGA, 4, false, "tga 4" },
+      { ImageFileTGA, 3, true, "tga 3 bottom up" },
+      { ImageFileTGA, 4, true, "tga 4 bottom up" }
+   };
+   const int numberFormats = sizeof(formats)/sizeof(formats[0]);
+   int f = random.range(0, numberFormats-1);
+   ImageFileFormat format = formats[f].format;
+   int channels = formats[f].channels;
+   bool bottomUp = formats[f].bottomUp;
+   int width = random.range(1, 200);
+   int height = random.range(1, 200);
+   Image picture(width, height);
+   fillRandom(picture, random.next());
+   keepChannels(picture, channels);
+   char setup[64];
+   sprintf(setup, "%s %dx%d", formats[f].name, width, height);
+
+   std::string path = tempPath(random, ImageFileLayout::getExtension(format));
+   bool saved = bottomUp ? saveBottomUpTGA(path.c_str(), picture, channels) :
+                           MappedImage::save(path.c_str(), picture, channels);
+   if(!saved) {
+      fail(stats, "file save", setup, "can't write the file");
+      remove(path.c_str());
+      return;
+   }
+
+   MappedImage mapped;
+   if(mapped.open(path.c_str()) && sameLayout(mapped.getLayout(), format, width, height, channels, bottomUp)) {
+      Image image;
+      readRows(mapped, image);
+      check(stats, "file mapped", setup, picture, image);
+   } else {
+      fail(stats, "file mapped", setup, "the header doesn't match");
+   }
+   mapped.close();
+
+   FILE *file = fopen(path.c_str(), "rb");
+   ImageReader reader;
+   Image streamed;
+   if(file && reader.open(file) && sameLayout(reader.getLayout(), format, width, height, channels, bottomUp) &&
+      reader.read(streamed))
+      check(stats, "file reader", setup, picture, streamed);
+   else
+      fail(stats, "file reader", setup, "can't read the file");
+   if(file)
+      fclose(file);
+
+   //the writer only writes top down files
+   MemoryStream stream = { std::vector<uint8_t>(), 0 };
+   ImageWriter writer;
+   std::vector<uint8_t> bytes;
+   if(writer.open(writeMemory, &stream, ImageFileLayout::make(format, width, height, channels)) &&
+      writer.write(picture)) {
+      if(!bottomUp && (!readBytes(path, bytes) || (bytes != stream.data)))
+         fail(stats, "file writer", setup, "other bytes than MappedImage::save()");
+      Image written;
+      if(reader.open(readMemory, &stream) && sameLayout(reader.getLayout(), format, width, height, channels, false) &&
+         reader.read(written))
+         check(stats, "file writer", setup, picture, written);
+      else
+         fail(stats, "file writer", setup, "can't read what it wrote");
+   } else {
+      fail(stats, "file writer", setup, "can't write");
+   }
+   remove(path.c_str());
+}
+
+//headers written by others: comments, whitespace and the lines of pam in any order, and broken
+//ones. no header is complete before its last byte, that is what ImageReader relies on
+static void verifyHeaders(VerifyStats &stats) {
+   static const struct {
+      const char *header;
+      bool valid;
+      int width, height, channels;
+   } headers[] = {
+      { "P6 # comment\n3\t2 # size\n# more\n255\n", true, 3, 2, 3 },
+      { "P7\nTUPLTYPE RGB_ALPHA\n# comment\nHEIGHT 2\nWIDTH 3\nMAXVAL 255\nDEPTH 4\nENDHDR\n", true, 3, 2, 4 },
+      { "P7\nWIDTH 3\nWIDTH x\nHEIGHT 2\nDEPTH 3\nMAXVAL 255\nENDHDR\n", false, 0, 0, 0 },
+      { "P7\nWIDTH 3\nHEIGHT 2\nDEPTH 3\nMAXVAL \nENDHDR\n", false, 0, 0, 0 },
+      { "P7\nWIDTH 3\nHEIGHT 2\nDEPTH 2\nMAXVAL 255\nENDHDR\n", false, 0, 0, 0 },
+      { "P6\n3 2\n65535\n", false, 0, 0, 0 },
+      { "P6\n4294967297 2\n255\n", false, 0, 0, 0 },
+      { "P6\n1048577 2\n255\n", false, 0, 0, 0 },
+      { "P7\nWIDTH 3\nHEIGHT 21474836472\nDEPTH 3\nMAXVAL 255\nENDHDR\n", false, 0, 0, 0 }
+   };
+   for(size_t h=0; h<sizeof(headers)/sizeof(headers[0]); ++h) {
+      const char *header = headers[h].header;
+      std::string setup = std::string("header \"") + header + "\"";
+      for(size_t i=0; i<setup.size(); ++i) {
+         if((setup[i] == '\n') || (setup[i] == '\t'))
+            setup[i] = ' ';
+      }
+      size_t headerSize = strlen(header);
+      MemoryStream stream = { std::vector<uint8_t>(header, header+headerSize), 0 };
+      stream.data.resize(headerSize + (size_t)headers[h].width*headers[h].height*headers[h].channels, 0x5a);
+      ImageFileLayout layout;
+      bool parsed = layout.parse(stream.data.data(), stream.data.size());
+      if(parsed != headers[h].valid) {
+         fail(stats, "file header", setup, parsed ? "a broken header is taken" : "a header is refused");
+         continue;
+      }
+      if(!parsed) {
+         stats.cases++;
+         continue;
+      }
+      if((layout.headerSize != headerSize) ||
+         !sameLayout(layout, layout.format, headers[h].width, headers[h].height, headers[h].channels, false)) {
+         fail(stats, "file header", setup, "wrong size, channels or header size");
+         continue;
+      }
+      bool early = false;
+      for(size_t i=0; i<headerSize; ++i)
+         early = early || layout.parse(stream.data.data(), i);
+      if(early) {
+         fail(stats, "file header", setup, "complete before its last byte");
+         continue;
+      }
+      ImageReader reader;
+      Image image;
+      if(!reader.open(readMemory, &stream) || !reader.read(image))
+         fail(stats, "file header", setup, "ImageReader can't read it");
+      else
+         stats.cases++;
+   }
+}
+
+static int verifyFiles(Random &random, int iterations) {
+   VerifyStats stats = { 0, 0 };
+   verifyHeaders(stats);
+   for(int i=0; i<iterations; ++i)
+      verifyFormat(stats, random);
+   summary("files", stats);
+   return stats.failures;
+}
+
+//=== blit
+
+template<class Processor> static void verifyProcessor(VerifyStats &stats, Random &random, ThreadPool &pool,
+                                                      const char *name) {
+   int sourceWidth = random.range(1, 80);
+   int sourceHeight = random.range(1, 80);
+   int picWidth = random.range(1, 100);
+   int picHeight = random.range(1, 100);
+   //a third unscaled, a third only scaled vertically, a third scaled on both axes
+   int mode = random.range(0, 2);
+   int width = (mode == 2) ? random.range(1, 160) : sourceWidth;
+   int height = (mode == 0) ? sourceHeight : random.range(1, 160);
+   //positions from fully left/above to fully right/below, with the picture borders more likely
+   int posX = random.range(0, 3) ? random.range(-width, picWidth) : (random.range(0, 1) ? 0 : picWidth-width);
+   int posY = random.range(0, 3) ? random.range(-height, picHeight) : (random.range(0, 1) ? 0 : picHeight-height);
+
+   Image sourceImage = randomImage(random, sourceWidth, sourceHeight);
+   Image sourceCopy(sourceWidth, sourceHeight);
+   copyPixels(cropped(sourceImage, sourceWidth, sourceHeight), sourceCopy);
+   Image expectedImage = randomImage(random, picWidth, picHeight);
+   Image actualImage(picWidth, picHeight);
+   Image parallelImage(picWidth, picHeight);
+   ImageView expected = cropped(expectedImage, picWidth, picHeight);
+   copyPixels(expected, actualImage);
+   copyPixels(expected, parallelImage);
+
+   Blitter::CopyDescr<uint32_t> source;
+   source.setView(cropped(sourceImage, sourceWidth, sourceHeight));
+   source.set(0, 0, sourceWidth, sourceHeight);
+   Blitter::CopyDescr<uint32_t> dest;
+   dest.setView(expected);
+   dest.set(posX, posY, width, height);
+   Reference::drawImage<uint32_t, uint32_t, Processor>(source, dest);
+   dest.setView(actualImage);
+   dest.set(posX, posY, width, height);
+   Blitter::drawImage<uint32_t, uint32_t, Processor>(source, dest);
+   //the serial blit may have moved the source rectangle while clipping
+   source.set(0, 0, sourceWidth, sourceHeight);
+   dest.setView(parallelImage);
+   dest.set(posX, posY, width, height);
+   Blitter::drawImage<uint32_t, uint32_t, Processor>(pool, source, dest);
+
+   char setup[128];
+   sprintf(setup, "%dx%d -> %dx%d at (%d,%d) in %dx%d", sourceWidth, sourceHeight, width, height,
+           posX, posY, picWidth, picHeight);
+   check(stats, name, setup, expected, actualImage);
+   check(stats, (std::string(name) + " parallel").c_str(), setup, expected, parallelImage);
+   check(stats, (std::string(name) + " (source)").c_str(), setup, sourceCopy,
+         cropped(sourceImage, sourceWidth, sourceHeight));
+}
+
+static int verifyBlit(Random &random, ThreadPool &pool, int iterations) {
+   VerifyStats stats = { 0, 0 };
+   for(int i=0; i<iterations; ++i) {
+      verifyProcessor<Blitter::CopyPixel>(stats, random, pool, "CopyPixel");
+      verifyProcessor<Blitter::ConvertGrayscaleToPixel<8> >(stats, random, pool, "ConvertGrayscaleToPixel<8>");
+      verifyProcessor<Blitter::BlendPixelFullTransparence>(stats, random, pool, "BlendPixelFullTransparence");
+      verifyProcessor<Blitter::BlendPixel1BitTransparence>(stats, random, pool, "BlendPixel1BitTransparence");
+   }
+   summary("blit", stats);
+   return stats.failures;
+}
+
+//=== blur
+
+enum { NestedPictures = 3 };
+
+static int verifyBlur(Random &random, ThreadPool &pool, int iterations) {
+   VerifyStats stats = { 0, 0 };
+   for(int i=0; i<iterations; ++i) {
+      int width = random.range(1, 120);
+      int height = random.range(1, 120);
+      //mostly small radii, sometimes bigger than the picture or than MaxRadius
+      int radiusX = random.range(0, 3) ? random.range(0, 24) : random.range(0, 300);
+      int radiusY = random.range(0, 3) ? random.range(0, 24) : random.range(0, 300);
+      Image sourceImage = randomImage(random, width, height);
+      ImageView source = cropped(sourceImage, width, height);
+      Image expected(width, height);
+      Image actual(width, height);
+      copyPixels(source, expected);
+      Reference::blur(expected, radiusX, radiusY);
+
+      char setup[128];
+      sprintf(setup, "%dx%d radius %d,%d", width, height, radiusX, radiusY);
+
+#ifdef IMAGEUTILS_SSE2
+      copyPixels(source, actual);
+      Stackblur::blurSSE2((uint32_t*)actual.data(), actual.view().pitch(), 0, 0, width, height, radiusX, radiusY);
+      check(stats, "blurSSE2", setup, expected, actual);
+#endif
+#ifdef IMAGEUTILS_AVX2
+      if(CpuFeatures::getDetectedLevel() >= CpuLevelAVX2) {
+         copyPixels(source, actual);
+         Stackblur::blurAVX2((uint32_t*)actual.data(), actual.view().pitch(), 0, 0, width, height, radiusX, radiusY);
+         check(stats, "blurAVX2", setup, expected, actual);
+      }
+#endif
+      copyPixels(source, actual);
+      Stackblur::blurFast(actual, radiusX, radiusY);
+      check(stats, "blurFast", setup, expected, actual);
+
+      copyPixels(source, actual);
+      Stackblur::blurParallel(pool, actual, radiusX, radiusY);
+      check(stats, "blurParallel", setup, expected, actual);
+
+      //several pictures at once, each of them split again: the nested run()s share the pool
+      Image nested[NestedPictures];
+      for(int n=0; n<NestedPictures; ++n) {
+         nested[n].create(width, height);
+         copyPixels(source, nested[n]);
+      }
+      pool.run(NestedPictures, [&](int n) {
+         Stackblur::blurParallel(pool, nested[n], radiusX, radiusY);
+      });
+      for(int n=0; n<NestedPictures; ++n)
+         check(stats, "blurParallel nested", setup, expected, nested[n]);
+
+      if(Stackblur::pyramidLevels(width, height, radiusX, radiusY) == 0) {
+         copyPixels(source, actual);
+         Stackblur::blurLarge(actual, radiusX, radiusY);
+         check(stats, "blurLarge", setup, expected, actual);
+      }
+
+      //a large radius on one axis leaves the other one alone: stripes along the blurred axis stay
+      int largeRadius = random.range(Stackblur::MaxRadius+1, 1000);
+      bool rows = random.range(0, 1) != 0;
+      Image stripes(width, height);
+      Image blurred(width, height);
+      for(int y=0; y<height; ++y) {
+         for(int x=0; x<width; ++x)
+            stripes.view().row<uint32_t>(y)[x] = 0x01234567u*(uint32_t)(rows ? y+1 : x+1) & 0xffffff;
+      }
+      copyPixels(stripes, blurred);
+      Stackblur::blurLarge(blurred, rows ? largeRadius : 0, rows ? 0 : largeRadius);
+      char stripeSetup[128];
+      sprintf(stripeSetup, "%dx%d radius %d,%d on %s", width, height, rows ? largeRadius : 0, rows ? 0 : largeRadius,
+              rows ? "rows" : "columns");
+      check(stats, "blurLarge one axis", stripeSetup, stripes, blurred, LargeStripeTolerance);
+
+      //the cache after a few random changes against a full blur of the changed picture
+      StackblurCache cache;
+      cache.setSource(source, radiusX, radiusY);
+      check(stats, "StackblurCache", setup, expected, cache.getResultView());
+      int changes = random.range(1, 4);
+      for(int c=0; c<changes; ++c) {
+         int x0 = random.range(0, width-1);
+         int y0 = random.range(0, height-1);
+         int x1 = x0 + random.range(1, 10);
+         int y1 = y0 + random.range(1, 10);
+         fillRandom(source.crop(x0, y0, x1-x0, y1-y0), random.next());
+         cache.invalidate(x0, y0, x1, y1);
+      }
+      cache.update();
+      copyPixels(source, expected);
+      Reference::blur(expected, radiusX, radiusY);
+      check(stats, "StackblurCache update", setup, expected, cache.getResultView());
+   }
+   summary("blur", stats);
+   return stats.failures;
+}
+
+//=== pixel formats
+
+//views the entry points that take 32 bit pixels refuse: gray ones and 32 bit ones with a stride
+//that isn't a whole number of pixels. the other side must stay as it was
+static int verifyPixelFormats(Random &random, ThreadPool &pool) {
+   VerifyStats stats = { 0, 0 };
+   static const struct {
+      PixelFormat format;
+      int padding;               //bytes after each row
+   } kinds[] = { { PixelFormatGray8, 0 }, { PixelFormatGray16, 0 }, { PixelFormatARGB8888, 2 } };
+   for(size_t k=0; k<sizeof(kinds)/sizeof(kinds[0]); ++k) {
+      PixelFormat format = kinds[k].format;
+      int width = random.range(8, 60);
+      int height = random.range(8, 60);
+      ptrdiff_t stride = (ptrdiff_t)width*bytesPerPixel(format) + kinds[k].padding;
+      std::vector<uint8_t> grayPixels((size_t)stride*height);
+      ImageView gray(grayPixels.data(), width, height, stride, format);
+      std::vector<uint8_t> grayCopy = grayPixels;
+      Image pixels = randomImage(random, width, height);
+      Image expected(width, height);
+      copyPixels(pixels, expected);
+      Image half = randomImage(random, width/2, height/2);
+      Image expectedHalf(width/2, height/2);
+      copyPixels(half, expectedHalf);
+
+      char setup[128];
+      sprintf(setup, "%dx%d format %d stride %d", width, height, (int)format, (int)stride);
+
+      ImageResize::resample<CatmullRomFilter>(gray, pixels);
+      ImageResize::resample<CatmullRomFilter>(pool, gray, pixels);
+      ImageResize::resampleLinear(pool, ResizeFilterCatmullRom, gray, pixels);
+      ImageResize::halve(gray, half);
+      check(stats, "resample (gray input)", setup, expected, pixels);
+      check(stats, "halve (gray input)", setup, expectedHalf, half);
+
+      ImageResize::resample<CatmullRomFilter>(pixels, gray);
+      ImageResize::resampleLinear(ResizeFilterCatmullRom, pixels, gray);
+      Stackblur::blur(gray, 3, 3);
+      Stackblur::blurFast(gray, 3, 3);
+      Stackblur::blurParallel(pool, gray, 3, 3);
+      Stackblur::blurLarge(gray, 300, 300);
+      Blitter::drawImage<uint32_t, uint32_t, Blitter::CopyPixel>(pixels, gray, 0, 0, width, height);
+      Blitter::drawImage<uint32_t, uint32_t, Blitter::CopyPixel>(gray, pixels, 0, 0, width, height);
+      check(stats, "blit (gray source)", setup, expected, pixels);
+      if(grayPixels != grayCopy)
+         fail(stats, "resample, blur and blit", setup, "gray view changed");
+      else
+         stats.cases++;
+
+      StackblurCache cache;
+      cache.setSource(gray, 3, 3);
+      cache.update();
+      if((cache.getWidth() != 0) || (cache.getHeight() != 0))
+         fail(stats, "StackblurCache", setup, "gray source taken");
+      else
+         stats.cases++;
+
+      std::string path = tempPath(random, ".ppm");
+      MemoryStream stream = { std::vector<uint8_t>(), 0 };
+      ImageWriter writer;
+      bool saved = MappedImage::save(path.c_str(), gray);
+      remove(path.c_str());
+      if(saved || (writer.open(writeMemory, &stream, ImageFileLayout::make(ImageFilePPM, width, height, 3)) &&
+                   writer.write(gray)))
+         fail(stats, "save and write", setup, "gray view taken");
+      else
+         stats.cases++;
+   }
+   summary("formats", stats);
+   return stats.failures;
+}
+
+int runVerify(int iterations, uint32_t seed) {
+   printf("verifying with seed %u\n", seed);
+   //every level sees the same cases, the dispatched kernels of each one against the reference
+   CpuLevel top = CpuFeatures::getLevel();
+   ThreadPool pool(3);
+   int failures = 0;
+   for(int level=CpuLevelScalar; level<=top; ++level) {
+      if(CpuFeatures::setLevel((CpuLevel)level) != level)
+         continue;
+      Random random(seed);
+      failures += verifyResize(random, pool, iterations);
+      failures += verifyBlit(random, pool, iterations);
+      failures += verifyBlur(random, pool, iterations);
+   }
+   CpuFeatures::setLevel(top);
+   //the file formats don't depend on the level
+   Random random(seed);
+   failures += verifyFiles(random, iterations);
+   failures += verifyPixelFormats(random, pool);
+   return failures;
+}
@@ -0,0 +1,38 @@
+
+//the differential checks of verify.cpp on their own, for ctest
+//
+//   imageutils_verify [--cpu level] [iterations] [--seed n]
+//
+//exits with 1 if any variant differs from the reference. the same checks as imageutils_bench
+//--verify, 200 iterations unless given
+
+#include "benchutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+   int iterations = 200;
+   uint32_t seed = 1;
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i], "--seed") && (i+1 < argc))
+         seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+      else if(!strcmp(argv[i], "--cpu") && (i+1 < argc)) {
+         CpuLevel level;
+         if(!CpuFeatures::parseLevel(argv[++i], level)) {
+            fprintf(stderr, "unknown cpu level %s\n", argv[i]);
+            return 1;
+         }
+         CpuFeatures::setLevel(level);
+      } else if((argv[i][0] != '-') && (atoi(argv[i]) > 0))
+         iterations = atoi(argv[i]);
+      else {
+         fprintf(stderr, "usage: %s [--cpu level] [iterations] [--seed n]\n", argv[0]);
+         return 1;
+      }
+   }
+   printf("cpu level %s (detected %s)\n", CpuFeatures::getLevelName(CpuFeatures::getLevel()),
+          CpuFeatures::getLevelName(CpuFeatures::getDetectedLevel()));
+   return (runVerify(iterations, seed) == 0) ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+
+#include "cpufeatures.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+   #include <intrin.h>
+   #define IMAGEUTILS_CPUID 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+   #include <cpuid.h>
+   #define IMAGEUTILS_CPUID 1
+#endif
+
+std::atomic<int> CpuFeatures::mLevel(-1);
+
+#ifdef IMAGEUTILS_CPUID
+static void cpuid(int leaf, int subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+   int info[4];
+   __cpuidex(info, leaf, subleaf);
+   for(int i=0; i<4; ++i)
+      regs[i] = (uint32_t)info[i];
+#else
+   __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+//which register sets the os saves on a task switch
+static uint64_t xgetbv() {
+#if defined(_MSC_VER)
+   return _xgetbv(0);
+#else
+   uint32_t eax, edx;
+   __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+   return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static CpuLevel detect() {
+   uint32_t regs[4];
+   cpuid(0, 0, regs);
+   uint32_t maxLeaf = regs[0];
+
+   cpuid(1, 0, regs);
+   if(!(regs[3] & (1u << 26)))               //sse2
+      return CpuLevelScalar;
+   bool osxsave = (regs[2] & (1u << 27)) != 0;
+   bool avx = (regs[2] & (1u << 28)) != 0;
+   if(!osxsave || !avx || (maxLeaf < 7))
+      return CpuLevelSSE2;
+
+   uint64_t xcr0 = xgetbv();
+   if((xcr0 & 0x6) != 0x6)                   //xmm and ymm state
+      return CpuLevelSSE2;
+   cpuid(7, 0, regs);
+   if(!(regs[1] & (1u << 5)))                //avx2
+      return CpuLevelSSE2;
+   if(!(regs[1] & (1u << 16)) || ((xcr0 & 0xe0) != 0xe0))     //avx512f, opmask and zmm state
+      return CpuLevelAVX2;
+   return CpuLevelAVX512;
+}
+#else
+static CpuLevel detect() {
+   return CpuLevelScalar;
+}
+#endif
+
+CpuLevel CpuFeatures::getDetectedLevel() {
+   static CpuLevel level = detect();
+   return level;
+}
+
+int CpuFeatures::initLevel() {
+   CpuLevel level = getDetectedLevel();
+   const char *name = getenv("IMAGEUTILS_CPU");
+   CpuLevel forced;
+   if(name && parseLevel(name, forced) && (forced < level))
+      level = forced;
+   int expected = -1;
+   //a racing setLevel() wins
+   mLevel.compare_exchange_strong(expected, (int)level);
+   return mLevel.load();
+}
+
+CpuLevel CpuFeatures::setLevel(CpuLevel level) {
+   if(level > getDetectedLevel())
+      level = getDetectedLevel();
+   mLevel.store((int)level);
+   return level;
+}
+
+const char *CpuFeatures::getLevelName(CpuLevel level) {
+   switch(level) {
+      case CpuLevelScalar: return "scalar";
+      case CpuLevelSSE2:   return "sse2";
+      case CpuLevelAVX2:   return "avx2";
+      case CpuLevelAVX512: return "avx512";
+      default:             return "unknown";
+   }
+}
+
+bool CpuFeatures::parseLevel(const char *name, CpuLevel &level) {
+   for(int i=0; i<NumberCpuLevels; ++i) {
+      if(!strcmp(name, getLevelName((CpuLevel)i))) {
+         level = (CpuLevel)i;
+         return true;
+      }
+   }
+   return false;
+}
@@ -0,0 +1,44 @@
+
+#ifndef __IMAGEUTILS_CPUFEATURES_H__
+#define __IMAGEUTILS_CPUFEATURES_H__
+
+#include "eastl/types.h"
+
+#include <atomic>
+
+//the instruction set levels the pixel kernels are chosen for. every level includes the ones below
+enum CpuLevel {
+   CpuLevelScalar,
+   CpuLevelSSE2,
+   CpuLevelAVX2,
+   CpuLevelAVX512,
+   NumberCpuLevels
+};
+
+//detects the cpu once. the kernel tables of ImageResize, Blitter and Stackblur are bound for
+//every level at compile time, getLevel() picks the one that is used. the environment variable
+//IMAGEUTILS_CPU=scalar|sse2|avx2|avx512 lowers the level for testing and benchmarking, a level
+//above what the cpu can do is never used
+class CpuFeatures {
+public:
+   static CpuLevel getDetectedLevel();
+
+   static CpuLevel getLevel() {
+      int level = mLevel.load(std::memory_order_relaxed);
+      if(level < 0)
+         level = initLevel();
+      return (CpuLevel)level;
+   }
+   //same as the environment variable, but at runtime. returns the level that is really used
+   static CpuLevel setLevel(CpuLevel level);
+
+   static const char *getLevelName(CpuLevel level);
+   static bool parseLevel(const char *name, CpuLevel &level);
+
+private:
+   static int initLevel();
+
+   static std::atomic<int> mLevel;
+};
+
+#endif   //#ifndef __IMAGEUTILS_CPUFEATURES_H__
@@ -0,0 +1,67 @@
+
+#include "image.h"
+
+ImageView ImageView::crop(int x, int y, int w, int h) const {
+   if(x < 0) {
+      w += x;
+      x = 0;
+   }
+   if(y < 0) {
+      h += y;
+      y = 0;
+   }
+   if(x+w > width)
+      w = width-x;
+   if(y+h > height)
+      h = height-y;
+   if((w <= 0) || (h <= 0))
+      return ImageView(data, 0, 0, stride, format);
+   return ImageView(data + y*stride + (ptrdiff_t)x*bytesPerPixel(format), w, h, stride, format);
+}
+
+Image::Image()
+   : mAllocation(nullptr) {
+}
+
+Image::Image(int width, int height, PixelFormat format)
+   : mAllocation(nullptr) {
+   create(width, height, format);
+}
+
+Image::Image(Image &&other)
+   : mAllocation(other.mAllocation), mView(other.mView) {
+   other.mAllocation = nullptr;
+   other.mView = ImageView();
+}
+
+Image &Image::operator=(Image &&other) {
+   if(this != &other) {
+      release();
+      mAllocation = other.mAllocation;
+      mView = other.mView;
+      other.mAllocation = nullptr;
+      other.mView = ImageView();
+   }
+   return *this;
+}
+
+Image::~Image() {
+   release();
+}
+
+void Image::create(int width, int height, PixelFormat format) {
+   release();
+   if((width <= 0) || (height <= 0))
+      return;
+   ptrdiff_t stride = alignedStride(width, format);
+   //RowAlignment-1 bytes to align the start, RowAlignment bytes of padding at the end
+   mAllocation = new uint8_t[stride*height + 2*RowAlignment-1];
+   uint8_t *data = (uint8_t*)(((uintptr_t)mAllocation + RowAlignment-1) & ~(uintptr_t)(RowAlignment-1));
+   mView = ImageView(data, width, height, stride, format);
+}
+
+void Image::release() {
+   delete[] mAllocation;
+   mAllocation = nullptr;
+   mView = ImageView();
+}
@@ -0,0 +1,143 @@
+
+#ifndef __IMAGEUTILS_IMAGE_H__
+#define __IMAGEUTILS_IMAGE_H__
+
+#include "eastl/types.h"
+
+enum PixelFormat {
+   PixelFormatARGB8888,       //uint32_t 0xAARRGGBB
+   PixelFormatXRGB8888,       //uint32_t 0x00RRGGBB, the top byte is ignored
+   PixelFormatGray8,
+   PixelFormatGray16,
+   PixelFormatGray32
+};
+
+inline int bytesPerPixel(PixelFormat format) {
+   switch(format) {
+      case PixelFormatGray8:  return 1;
+      case PixelFormatGray16: return 2;
+      default:                return 4;
+   }
+}
+
+//a window into pixels owned by someone else. rows are stride bytes apart, so a crop is just
+//another view into the same memory
+struct ImageView {
+   uint8_t *data;
+   int width, height;
+   ptrdiff_t stride;          //bytes from one row to the next
+   PixelFormat format;
+
+   ImageView()
+      : data(nullptr), width(0), height(0), stride(0), format(PixelFormatARGB8888) {
+   }
+   ImageView(void *data, int width, int height, ptrdiff_t stride, PixelFormat format = PixelFormatARGB8888)
+      : data((uint8_t*)data), width(width), height(height), stride(stride), format(format) {
+   }
+   //rows of width pixels without gaps
+   template<typename PixelType> static ImageView fromPixels(PixelType *pixels, int width, int height,
+                                                            PixelFormat format = PixelFormatARGB8888) {
+      return ImageView(pixels, width, height, (ptrdiff_t)width*sizeof(PixelType), format);
+   }
+
+   template<typename PixelType> PixelType *row(int y) const {
+      return (PixelType*)(data + y*stride);
+   }
+   template<typename PixelType> PixelType *pixel(int x, int y) const {
+      return row<PixelType>(y) + x;
+   }
+
+   //the sub rectangle [x, x+w) x [y, y+h), clipped against the view
+   ImageView crop(int x, int y, int w, int h) const;
+
+   //stride in pixels, only meaningful when the stride is a multiple of the pixel size
+   int pitch() const { return (int)(stride / bytesPerPixel(format)); }
+   bool isEmpty() const { return (data == nullptr) || (width <= 0) || (height <= 0); }
+   bool isContiguous() const { return stride == (ptrdiff_t)width*bytesPerPixel(format); }
+   //resize and blur take only views of 32 bit pixels with a stride of whole pixels, they do nothing
+   //with the others
+   bool is32Bit() const { return (bytesPerPixel(format) == 4) && (stride % 4 == 0); }
+};
+
+//owns its pixels. every row starts on a RowAlignment byte boundary and the buffer ends with at
+//least RowAlignment bytes of padding, so vector kernels may load a whole register at the end of
+//any row
+class Image {
+public:
+   enum { RowAlignment = 64 };
+
+   Image();
+   Image(int width, int height, PixelFormat format = PixelFormatARGB8888);
+   Image(Image &&other);
+   Image &operator=(Image &&other);
+   ~Image();
+
+   void create(int width, int height, PixelFormat format = PixelFormatARGB8888);
+   void release();
+
+   const ImageView &view() const { return mView; }
+   operator const ImageView &() const { return mView; }
+
+   uint8_t *data() const { return mView.data; }
+   int width() const { return mView.width; }
+   int height() const { return mView.height; }
+   ptrdiff_t stride() const { return mView.stride; }
+   PixelFormat format() const { return mView.format; }
+   template<typename PixelType> PixelType *row(int y) const { return mView.row<PixelType>(y); }
+
+   static ptrdiff_t alignedStride(int width, PixelFormat format) {
+      ptrdiff_t bytes = (ptrdiff_t)width*bytesPerPixel(format);
+      return (bytes + RowAlignment-1) & ~(ptrdiff_t)(RowAlignment-1);
+   }
+
+private:
+   Image(const Image &);
+   Image &operator=(const Image &);
+
+   uint8_t *mAllocation;
+   ImageView mView;
+};
+
+//pictures that come in or go out row by row instead of lying in memory as a whole, files for
+//example. rows are handled in strips from top to bottom, the rows of one strip may be read or
+//written by several threads at once
+class RowSource {
+public:
+   virtual ~RowSource() {}
+   virtual int getWidth() const = 0;
+   virtual int getHeight() const = 0;
+   //row y as 32 bit pixels, either the row itself or converted into buffer (getWidth() pixels)
+   virtual const uint32_t *readRow(int y, uint32_t *buffer) const = 0;
+   //the rows above rowEnd are most likely not read again
+   virtual void releaseRows(int rowEnd) { (void)rowEnd; }
+};
+
+class RowSink {
+public:
+   virtual ~RowSink() {}
+   virtual int getWidth() const = 0;
+   virtual int getHeight() const = 0;
+   //where row y is written to, the row itself or buffer (getWidth() pixels)
+   virtual uint32_t *beginRow(int y, uint32_t *buffer) = 0;
+   //the pointer beginRow() returned, now filled with the row
+   virtual void endRow(int y, const uint32_t *row) = 0;
+   //the rows above rowEnd are complete
+   virtual void releaseRows(int rowEnd) { (void)rowEnd; }
+};
+
+//the rows of a 32 bit view, both ways without copying
+class ViewRows : public RowSource, public RowSink {
+public:
+   explicit ViewRows(const ImageView &view) : mView(view) {}
+
+   int getWidth() const { return mView.width; }
+   int getHeight() const { return mView.height; }
+   const uint32_t *readRow(int y, uint32_t *) const { return mView.row<uint32_t>(y); }
+   uint32_t *beginRow(int y, uint32_t *) { return mView.row<uint32_t>(y); }
+   void endRow(int, const uint32_t *) {}
+
+private:
+   ImageView mView;
+};
+
+#endif   //#ifndef __IMAGEUTILS_IMAGE_H__
@@ -0,0 +1,599 @@
+
+#include "imagefile.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <new>
+
+#ifdef _WIN32
+   #define WIN32_LEAN_AND_MEAN
+   #define NOMINMAX
+   #include <windows.h>
+#else
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
+
+//=== MappedFile
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+   : mData(nullptr), mSize(0), mWritable(false), mFile(INVALID_HANDLE_VALUE), mMapping(nullptr) {
+}
+
+bool MappedFile::openRead(const char *path) {
+   close();
+   mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   LARGE_INTEGER size;
+   if((mFile == INVALID_HANDLE_VALUE) || !GetFileSizeEx(mFile, &size) || (size.QuadPart == 0)) {
+      close();
+      return false;
+   }
+   mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   mData = mMapping ? (uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+   if(!mData) {
+      close();
+      return false;
+   }
+   mSize = (uint64_t)size.QuadPart;
+   return true;
+}
+
+bool MappedFile::create(const char *path, uint64_t size) {
+   close();
+   if(size == 0)
+      return false;
+   mFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if(mFile == INVALID_HANDLE_VALUE) {
+      close();
+      return false;
+   }
+   //the mapping grows the file to its size
+   mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+   mData = mMapping ? (uint8_t*)MapViewOfFile(mMapping, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+   if(!mData) {
+      close();
+      return false;
+   }
+   mSize = size;
+   mWritable = true;
+   return true;
+}
+
+void MappedFile::close() {
+   if(mData)
+      UnmapViewOfFile(mData);
+   if(mMapping)
+      CloseHandle(mMapping);
+   if(mFile != INVALID_HANDLE_VALUE)
+      CloseHandle(mFile);
+   mData = nullptr;
+   mMapping = nullptr;
+   mFile = INVALID_HANDLE_VALUE;
+   mSize = 0;
+   mWritable = false;
+}
+
+void MappedFile::adviseSequential() {
+   //FILE_FLAG_SEQUENTIAL_SCAN on opening already does it
+}
+
+void MappedFile::release(uint64_t offset, uint64_t length) {
+   //unlocking pages that aren't locked takes them out of the working set
+   if(mData && (offset < mSize))
+      VirtualUnlock(mData+offset, (SIZE_T)eastl::min(length, mSize-offset));
+}
+
+#else
+
+MappedFile::MappedFile()
+   : mData(nullptr), mSize(0), mWritable(false), mFile(-1) {
+}
+
+bool MappedFile::openRead(const char *path) {
+   close();
+   mFile = ::open(path, O_RDONLY);
+   struct stat info;
+   if((mFile < 0) || (fstat(mFile, &info) != 0) || (info.st_size <= 0)) {
+      close();
+      return false;
+   }
+   void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, mFile, 0);
+   if(data == MAP_FAILED) {
+      close();
+      return false;
+   }
+   mData = (uint8_t*)data;
+   mSize = (uint64_t)info.st_size;
+   return true;
+}
+
+bool MappedFile::create(const char *path, uint64_t size) {
+   close();
+   if(size == 0)
+      return false;
+   mFile = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if((mFile < 0) || (ftruncate(mFile, (off_t)size) != 0)) {
+      close();
+      return false;
+   }
+   void *data = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0);
+   if(data == MAP_FAILED) {
+      close();
+      return false;
+   }
+   mData = (uint8_t*)data;
+   mSize = size;
+   mWritable = true;
+   return true;
+}
+
+void MappedFile::close() {
+   if(mData)
+      munmap(mData, (size_t)mSize);
+   if(mFile >= 0)
+      ::close(mFile);
+   mData = nullptr;
+   mFile = -1;
+   mSize = 0;
+   mWritable = false;
+}
+
+void MappedFile::adviseSequential() {
+   if(mData)
+      madvise(mData, (size_t)mSize, MADV_SEQUENTIAL);
+}
+
+void MappedFile::release(uint64_t offset, uint64_t length) {
+   if(!mData || (offset >= mSize))
+      return;
+   //whole pages only, the page with the end of the range may still be in use
+   uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+   uint64_t end = eastl::min(offset+length, mSize);
+   uint64_t begin = offset & ~(pageSize-1);
+   end &= ~(pageSize-1);
+   if(end <= begin)
+      return;
+   //dropping shared pages keeps their data in the file, the sync only starts writing them early
+   if(mWritable)
+      msync(mData+begin, (size_t)(end-begin), MS_ASYNC);
+   madvise(mData+begin, (size_t)(end-begin), MADV_DONTNEED);
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+   close();
+}
+
+//=== ImageFileLayout
+
+ImageFileLayout ImageFileLayout::make(ImageFileFormat format, int width, int height, int channels) {
+   ImageFileLayout layout;
+   layout.format = format;
+   layout.width = width;
+   layout.height = height;
+   if(format == ImageFilePPM)
+      channels = 3;
+   else if(format == ImageFileRaw)
+      channels = 4;
+   layout.channels = channels;
+   return layout;
+}
+
+bool ImageFileLayout::formatFromPath(const char *path, ImageFileFormat &format) {
+   const char *extension = strrchr(path, '.');
+   if(!extension || strchr(extension, '/') || strchr(extension, '\\'))
+      return false;
+   static const ImageFileFormat formats[] = {ImageFileRaw, ImageFilePPM, ImageFilePAM, ImageFileTGA};
+   for(ImageFileFormat candidate : formats) {
+      const char *name = getExtension(candidate);
+      size_t i = 0;
+      while(name[i] && extension[i] && (tolower((unsigned char)extension[i]) == name[i]))
+         i++;
+      if(!name[i] && !extension[i]) {
+         format = candidate;
+         return true;
+      }
+   }
+   return false;
+}
+
+const char *ImageFileLayout::getExtension(ImageFileFormat format) {
+   switch(format) {
+      case ImageFilePPM: return ".ppm";
+      case ImageFilePAM: return ".pam";
+      case ImageFileTGA: return ".tga";
+      default: return ".raw";
+   }
+}
+
+bool ImageFileLayout::isValid() const {
+   if((width <= 0) || (height <= 0) || (width > MaxSide) || (height > MaxSide))
+      return false;
+   switch(format) {
+      case ImageFileRaw: return channels == 4;
+      case ImageFilePPM: return channels == 3;
+      case ImageFilePAM: return (channels == 3) || (channels == 4);
+      //16 bit sizes in the header
+      case ImageFileTGA: return ((channels == 3) || (channels == 4)) && (width <= 0xffff) && (height <= 0xffff);
+   }
+   return false;
+}
+
+//the next number of a pnm header, whitespace and comments before it are skipped. a number that
+//runs up to the end of the data may not be complete yet and fails
+static bool readHeaderNumber(const uint8_t *data, uint64_t size, uint64_t &position, int &value) {
+   for(;;) {
+      while((position < size) && ((data[position] == ' ') || (data[position] == '\t') ||
+                                  (data[position] == '\r') || (data[position] == '\n')))
+         position++;
+      if((position < size) && (data[position] == '#')) {
+         while((position < size) && (data[position] != '\n'))
+            position++;
+         continue;
+      }
+      break;
+   }
+   if((position >= size) || (data[position] < '0') || (data[position] > '9'))
+      return false;
+   //a number that doesn't fit into an int fails as a whole, its digits aren't left for the next one
+   int64_t number = 0;
+   while((position < size) && (data[position] >= '0') && (data[position] <= '9')) {
+      number = number*10 + (data[position++]-'0');
+      if(number > INT_MAX)
+         return false;
+   }
+   value = (int)number;
+   return position < size;
+}
+
+static int readLittleEndian16(const uint8_t *data) {
+   return data[0] | (data[1] << 8);
+}
+
+bool ImageFileLayout::parse(const uint8_t *data, uint64_t size) {
+   *this = ImageFileLayout();
+   if(size < 2)
+      return false;
+   uint64_t position = 2;
+   int maxValue = 0;
+   if((data[0] == 'P') && (data[1] == '6')) {
+      format = ImageFilePPM;
+      channels = 3;
+      if(!readHeaderNumber(data, size, position, width) || !readHeaderNumber(data, size, position, height) ||
+         !readHeaderNumber(data, size, position, maxValue))
+         return false;
+      //exactly one whitespace between the header and the pixels
+      position++;
+   } else if((data[0] == 'P') && (data[1] == '7')) {
+      format = ImageFilePAM;
+      channels = 0;
+      //one "KEYWORD value" per line up to ENDHDR
+      for(;;) {
+         while((position < size) && (data[position] == '\n'))
+            position++;
+         uint64_t lineEnd = position;
+         while((lineEnd < size) && (data[lineEnd] != '\n'))
+            lineEnd++;
+         if(lineEnd >= size)
+            return false;
+         const char *line = (const char*)&data[position];
+         size_t length = (size_t)(lineEnd-position);
+         uint64_t value = position;
+         while((value < lineEnd) && (data[value] != ' '))
+            value++;
+         //the numbers end at the newline
+         if((length >= 6) && !strncmp(line, "ENDHDR", 6)) {
+            position = lineEnd+1;
+            break;
+         } else if((length > 6) && !strncmp(line, "WIDTH ", 6)) {
+            if(!readHeaderNumber(data, lineEnd+1, value, width))
+               return false;
+         } else if((length > 7) && !strncmp(line, "HEIGHT ", 7)) {
+            if(!readHeaderNumber(data, lineEnd+1, value, height))
+               return false;
+         } else if((length > 6) && !strncmp(line, "DEPTH ", 6)) {
+            if(!readHeaderNumber(data, lineEnd+1, value, channels))
+               return false;
+         } else if((length > 7) && !strncmp(line, "MAXVAL ", 7)) {
+            if(!readHeaderNumber(data, lineEnd+1, value, maxValue))
+               return false;
+         }
+         //TUPLTYPE and comments are ignored, DEPTH says everything
+         position = lineEnd+1;
+      }
+   } else {
+      //tga has no signature, only uncompressed true color without a color map is taken
+      if((size < 18) || (data[1] != 0) || (data[2] != 2) || ((data[16] != 24) && (data[16] != 32)) ||
+         (data[17] & 0x10))
+         return false;
+      format = ImageFileTGA;
+      channels = data[16]/8;
+      width = readLittleEndian16(&data[12]);
+      height = readLittleEndian16(&data[14]);
+      bottomUp = !(data[17] & 0x20);
+      position = 18 + data[0];
+      maxValue = 255;
+   }
+   if(((format != ImageFileTGA) && (maxValue != 255)) || !isValid() || (position > size))
+      return false;
+   headerSize = position;
+   return true;
+}
+
+int ImageFileLayout::writeHeader(uint8_t *header) {
+   int size = 0;
+   if(format == ImageFilePPM) {
+      size = sprintf((char*)header, "P6\n%d %d\n255\n", width, height);
+   } else if(format == ImageFilePAM) {
+      size = sprintf((char*)header, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+                     width, height, channels, (channels == 4) ? "RGB_ALPHA" : "RGB");
+   } else if(format == ImageFileTGA) {
+      memset(header, 0, 18);
+      header[2] = 2;
+      header[12] = (uint8_t)width;
+      header[13] = (uint8_t)(width >> 8);
+      header[14] = (uint8_t)height;
+      header[15] = (uint8_t)(height >> 8);
+      header[16] = (uint8_t)(channels*8);
+      //top row first, so files are written in the order of the rows. 8 bits of alpha with 32 bit
+      header[17] = 0x20 | ((channels == 4) ? 8 : 0);
+      size = 18;
+   }
+   bottomUp = false;
+   headerSize = size;
+   return size;
+}
+
+void ImageFileLayout::unpackRow(const uint8_t *src, uint32_t *dst) const {
+   //tga stores bgr, the others rgb
+   int red = (format == ImageFileTGA) ? 2 : 0;
+   int blue = 2-red;
+   if(format == ImageFileRaw) {
+      memcpy(dst, src, (size_t)width*4);
+   } else if(channels == 4) {
+      for(int x=0; x<width; ++x, src+=4)
+         dst[x] = ((uint32_t)src[3] << 24) | ((uint32_t)src[red] << 16) | ((uint32_t)src[1] << 8) | src[blue];
+   } else {
+      for(int x=0; x<width; ++x, src+=3)
+         dst[x] = 0xff000000 | ((uint32_t)src[red] << 16) | ((uint32_t)src[1] << 8) | src[blue];
+   }
+}
+
+void ImageFileLayout::packRow(const uint32_t *src, uint8_t *dst) const {
+   int red = (format == ImageFileTGA) ? 2 : 0;
+   int blue = 2-red;
+   if(format == ImageFileRaw) {
+      memcpy(dst, src, (size_t)width*4);
+      return;
+   }
+   for(int x=0; x<width; ++x, dst+=channels) {
+      uint32_t pixel = src[x];
+      dst[red] = (uint8_t)(pixel >> 16);
+      dst[1] = (uint8_t)(pixel >> 8);
+      dst[blue] = (uint8_t)pixel;
+      if(channels == 4)
+         dst[3] = (uint8_t)(pixel >> 24);
+   }
+}
+
+//=== MappedImage
+
+MappedImage::MappedImage()
+   : mReleased(0) {
+}
+
+bool MappedImage::open(const char *path) {
+   close();
+   if(!mFile.openRead(path) || !mLayout.parse(mFile.data(), mFile.size()) ||
+      (mLayout.getFileSize() > mFile.size())) {
+      close();
+      return false;
+   }
+   mFile.adviseSequential();
+   return true;
+}
+
+bool MappedImage::openRaw(const char *path, int width, int height) {
+   close();
+   mLayout = ImageFileLayout::make(ImageFileRaw, width, height, 4);
+   if(!mLayout.isValid() || !mFile.openRead(path) || (mFile.size() < mLayout.getFileSize())) {
+      close();
+      return false;
+   }
+   mFile.adviseSequential();
+   return true;
+}
+
+bool MappedImage::create(const char *path, ImageFileFormat format, int width, int height, int channels) {
+   close();
+   ImageFileLayout layout = ImageFileLayout::make(format, width, height, channels);
+   if(!layout.isValid())
+      return false;
+   uint8_t header[ImageFileLayout::MaxHeaderSize];
+   int headerSize = layout.writeHeader(header);
+   if(!mFile.create(path, layout.getFileSize()))
+      return false;
+   memcpy(mFile.data(), header, headerSize);
+   mLayout = layout;
+   mFile.adviseSequential();
+   return true;
+}
+
+void MappedImage::close() {
+   mFile.close();
+   mLayout = ImageFileLayout();
+   mReleased = 0;
+}
+
+ImageView MappedImage::view() const {
+   if((mLayout.format != ImageFileRaw) || !mFile.isOpen())
+      return ImageView();
+   return ImageView(mFile.data(), mLayout.width, mLayout.height, (ptrdiff_t)mLayout.getRowBytes());
+}
+
+const uint32_t *MappedImage::readRow(int y, uint32_t *buffer) const {
+   const uint8_t *src = rowData(y);
+   if(mLayout.format == ImageFileRaw)
+      return (const uint32_t*)src;
+   mLayout.unpackRow(src, buffer);
+   return buffer;
+}
+
+uint32_t *MappedImage::beginRow(int y, uint32_t *buffer) {
+   return (mLayout.format == ImageFileRaw) ? (uint32_t*)rowData(y) : buffer;
+}
+
+void MappedImage::endRow(int y, const uint32_t *row) {
+   if(mLayout.format != ImageFileRaw)
+      mLayout.packRow(row, rowData(y));
+}
+
+void MappedImage::releaseRows(int rowEnd) {
+   if(rowEnd <= mReleased)
+      return;
+   //in a bottom up file the rows that are done are at its end
+   int begin = mLayout.bottomUp ? mLayout.height-rowEnd : mReleased;
+   uint64_t rowBytes = mLayout.getRowBytes();
+   mFile.release(mLayout.headerSize + (uint64_t)begin*rowBytes, (uint64_t)(rowEnd-mReleased)*rowBytes);
+   mReleased = rowEnd;
+}
+
+bool MappedImage::load(const char *path, Image &image) {
+   MappedImage file;
+   if(!file.open(path))
+      return false;
+   image.create(file.getWidth(), file.getHeight());
+   ImageView view = image.view();
+   for(int y=0; y<view.height; ++y) {
+      uint32_t *row = view.row<uint32_t>(y);
+      const uint32_t *src = file.readRow(y, row);
+      if(src != row)
+         memcpy(row, src, (size_t)view.width*4);
+   }
+   return true;
+}
+
+bool MappedImage::save(const char *path, const ImageView &view, int channels) {
+   ImageFileFormat format;
+   MappedImage file;
+   if(!view.is32Bit() || !ImageFileLayout::formatFromPath(path, format) || !file.create(path, format, view.width, view.height, channels))
+      return false;
+   for(int y=0; y<view.height; ++y) {
+      uint32_t *src = view.row<uint32_t>(y);
+      uint32_t *row = file.beginRow(y, src);
+      if(row != src)
+         memcpy(row, src, (size_t)view.width*4);
+      file.endRow(y, row);
+   }
+   return true;
+}
+
+//=== ImageReader
+
+ImageReader::ImageReader()
+   : mRead(nullptr), mContext(nullptr), mRow(0) {
+}
+
+static size_t readFile(void *context, void *data, size_t size) {
+   return fread(data, 1, size, (FILE*)context);
+}
+
+bool ImageReader::open(ReadFunction read, void *context) {
+   mRead = read;
+   mContext = context;
+   mRow = 0;
+   //the header one byte at a time, the stream mustn't be read beyond it
+   mBuffer.clear();
+   uint8_t byte;
+   while(mBuffer.size() < ImageFileLayout::MaxHeaderSize) {
+      if(read(context, &byte, 1) != 1)
+         break;
+      mBuffer.push_back(byte);
+      if(mLayout.parse(mBuffer.data(), mBuffer.size()) && (mLayout.headerSize == mBuffer.size())) {
+         mBuffer.resize((size_t)mLayout.getRowBytes());
+         return true;
+      }
+   }
+   mLayout = ImageFileLayout();
+   return false;
+}
+
+bool ImageReader::open(FILE *file) {
+   return open(readFile, file);
+}
+
+bool ImageReader::readRow(uint32_t *row) {
+   if(!mRead || (mRow >= mLayout.height) || (mRead(mContext, mBuffer.data(), mBuffer.size()) != mBuffer.size()))
+      return false;
+   mLayout.unpackRow(mBuffer.data(), row);
+   mRow++;
+   return true;
+}
+
+bool ImageReader::read(Image &image) {
+   //the size comes from the stream, a picture that doesn't fit into memory is a failed read
+   try {
+      image.create(mLayout.width, mLayout.height);
+   } catch(const std::bad_alloc &) {
+      return false;
+   }
+   ImageView view = image.view();
+   for(int y=mRow; y<mLayout.height; ++y) {
+      if(!readRow(view.row<uint32_t>(mLayout.fileRow(y))))
+         return false;
+   }
+   return true;
+}
+
+//=== ImageWriter
+
+ImageWriter::ImageWriter()
+   : mWrite(nullptr), mContext(nullptr) {
+}
+
+static size_t writeFile(void *context, const void *data, size_t size) {
+   return fwrite(data, 1, size, (FILE*)context);
+}
+
+bool ImageWriter::open(WriteFunction write, void *context, const ImageFileLayout &layout) {
+   mWrite = nullptr;
+   mLayout = layout;
+   if(!mLayout.isValid())
+      return false;
+   uint8_t header[ImageFileLayout::MaxHeaderSize];
+   int headerSize = mLayout.writeHeader(header);
+   if(write(context, header, headerSize) != (size_t)headerSize)
+      return false;
+   mWrite = write;
+   mContext = context;
+   mBuffer.resize((size_t)mLayout.getRowBytes());
+   return true;
+}
+
+bool ImageWriter::open(FILE *file, const ImageFileLayout &layout) {
+   return open(writeFile, file, layout);
+}
+
+bool ImageWriter::writeRow(const uint32_t *row) {
+   if(!mWrite)
+      return false;
+   mLayout.packRow(row, mBuffer.data());
+   return mWrite(mContext, mBuffer.data(), mBuffer.size()) == mBuffer.size();
+}
+
+bool ImageWriter::write(const ImageView &view) {
+   if(!view.is32Bit() || (view.width != mLayout.width) || (view.height != mLayout.height))
+      return false;
+   for(int y=0; y<view.height; ++y) {
+      if(!writeRow(view.row<uint32_t>(y)))
+         return false;
+   }
+   return true;
+}
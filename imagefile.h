@@ -0,0 +1,188 @@
+
+#ifndef __IMAGEUTILS_IMAGEFILE_H__
+#define __IMAGEUTILS_IMAGEFILE_H__
+
+#include "eastl/types.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <vector>
+
+//a whole file mapped into memory, read only or read/write
+class MappedFile {
+public:
+   MappedFile();
+   ~MappedFile();
+
+   bool openRead(const char *path);
+   //creates or truncates the file to size bytes
+   bool create(const char *path, uint64_t size);
+   void close();
+
+   uint8_t *data() const { return mData; }
+   uint64_t size() const { return mSize; }
+   bool isOpen() const { return mData != nullptr; }
+
+   //the file is going to be walked through from front to back
+   void adviseSequential();
+   //drops the pages of [offset, offset+length) from the memory of the process. written data stays
+   //in the file, reading the range again maps it in again
+   void release(uint64_t offset, uint64_t length);
+
+private:
+   MappedFile(const MappedFile &);
+   MappedFile &operator=(const MappedFile &);
+
+   uint8_t *mData;
+   uint64_t mSize;
+   bool mWritable;
+#ifdef _WIN32
+   void *mFile;
+   void *mMapping;
+#else
+   int mFile;
+#endif
+};
+
+enum ImageFileFormat {
+   ImageFileRaw,        //no header, 32 bit pixels as in memory
+   ImageFilePPM,        //P6, 8 bit rgb
+   ImageFilePAM,        //P7, 8 bit rgb or rgb with alpha
+   ImageFileTGA         //uncompressed true color, 24 or 32 bit
+};
+
+//what the header of a file says and how its rows are stored
+struct ImageFileLayout {
+   ImageFileFormat format;
+   int width, height;
+   int channels;              //bytes per pixel in the file, 3 or 4 (raw always 4)
+   bool bottomUp;             //tga files may start with the bottom row
+   uint64_t headerSize;
+
+   ImageFileLayout()
+      : format(ImageFileRaw), width(0), height(0), channels(4), bottomUp(false), headerSize(0) {
+   }
+   //the layout of a new file, ppm has 3 and raw 4 channels whatever is asked for
+   static ImageFileLayout make(ImageFileFormat format, int width, int height, int channels);
+   //from the extension of the path: .raw .ppm .pam .tga
+   static bool formatFromPath(const char *path, ImageFileFormat &format);
+   static const char *getExtension(ImageFileFormat format);
+
+   //a size and channels that the format can store, no side longer than MaxSide
+   bool isValid() const;
+
+   uint64_t getRowBytes() const { return (uint64_t)width*channels; }
+   uint64_t getFileSize() const { return headerSize + getRowBytes()*height; }
+   //the row of the file in which row y of the picture is
+   int fileRow(int y) const { return bottomUp ? height-1-y : y; }
+
+   //parses the ppm, pam or tga header at the start of data. fails as well when the header isn't
+   //complete within size bytes, so a stream can try again with more
+   bool parse(const uint8_t *data, uint64_t size);
+   //writes the header of the layout and sets headerSize. header needs MaxHeaderSize bytes
+   int writeHeader(uint8_t *header);
+
+   //one row of the file from and to 32 bit pixels
+   void unpackRow(const uint8_t *src, uint32_t *dst) const;
+   void packRow(const uint32_t *src, uint8_t *dst) const;
+
+   enum { MaxHeaderSize = 4096 };
+   //keeps the row buffers of a header from anywhere at a few megabytes
+   enum { MaxSide = 1 << 20 };
+};
+
+//a raw, ppm, pam or tga file mapped into memory and used as a picture row by row. raw files are
+//read and written in place, the others are converted from and to 32 bit pixels one row at a time.
+//as RowSource and RowSink the rows that are done are dropped from memory again, so a file of any
+//size streams through a small part of the address space
+class MappedImage : public RowSource, public RowSink {
+public:
+   MappedImage();
+
+   //a ppm, pam or tga file, the format is taken from the header
+   bool open(const char *path);
+   bool openRaw(const char *path, int width, int height);
+   //channels is 3 or 4 for pam and tga, 3 for ppm and 4 for raw
+   bool create(const char *path, ImageFileFormat format, int width, int height, int channels = 3);
+   void close();
+
+   int getWidth() const { return mLayout.width; }
+   int getHeight() const { return mLayout.height; }
+   ImageFileFormat getFormat() const { return mLayout.format; }
+   int getChannels() const { return mLayout.channels; }
+   const ImageFileLayout &getLayout() const { return mLayout; }
+
+   //the pixels themselves for raw files, an empty view for the others
+   ImageView view() const;
+
+   const uint32_t *readRow(int y, uint32_t *buffer) const;
+   uint32_t *beginRow(int y, uint32_t *buffer);
+   void endRow(int y, const uint32_t *row);
+   void releaseRows(int rowEnd);
+
+   //a whole file into a new picture and a 32 bit picture into a new file, the format of the new
+   //file comes from the extension of the path
+   static bool load(const char *path, Image &image);
+   static bool save(const char *path, const ImageView &view, int channels = 3);
+
+private:
+   uint8_t *rowData(int y) const {
+      return mFile.data() + mLayout.headerSize + (uint64_t)mLayout.fileRow(y)*mLayout.getRowBytes();
+   }
+
+   MappedFile mFile;
+   ImageFileLayout mLayout;
+   int mReleased;             //rows above this one are released
+};
+
+//reads a ppm, pam or tga file from a stream, for pipes and everything else that can't be mapped.
+//the rows come in the order of the file
+class ImageReader {
+public:
+   //returns the number of bytes read, less than size only at the end or on an error
+   typedef size_t (*ReadFunction)(void *context, void *data, size_t size);
+
+   ImageReader();
+
+   bool open(ReadFunction read, void *context);
+   bool open(FILE *file);
+
+   const ImageFileLayout &getLayout() const { return mLayout; }
+   //the next row of the file, false after the last one or on a read error
+   bool readRow(uint32_t *row);
+   //all rows into a new picture, bottom up files the right way round
+   bool read(Image &image);
+
+private:
+   ReadFunction mRead;
+   void *mContext;
+   ImageFileLayout mLayout;
+   int mRow;
+   std::vector<uint8_t> mBuffer;
+};
+
+//writes a ppm, pam or tga file to a stream, top row first
+class ImageWriter {
+public:
+   //returns the number of bytes written, less than size only on an error
+   typedef size_t (*WriteFunction)(void *context, const void *data, size_t size);
+
+   ImageWriter();
+
+   //writes the header. layout.bottomUp is ignored
+   bool open(WriteFunction write, void *context, const ImageFileLayout &layout);
+   bool open(FILE *file, const ImageFileLayout &layout);
+
+   const ImageFileLayout &getLayout() const { return mLayout; }
+   bool writeRow(const uint32_t *row);
+   //all rows of a 32 bit picture of the size of the layout
+   bool write(const ImageView &view);
+
+private:
+   WriteFunction mWrite;
+   void *mContext;
+   ImageFileLayout mLayout;
+   std::vector<uint8_t> mBuffer;
+};
+
+#endif   //#ifndef __IMAGEUTILS_IMAGEFILE_H__
@@ -0,0 +1,108 @@
+
+#include "instrument.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+Instrument::AtomicCounters Instrument::mCounters[NumberStages];
+std::atomic<bool> Instrument::mTracing(false);
+
+namespace {
+   struct TraceEvent {
+      Instrument::Stage stage;
+      int thread;
+      int64_t start;
+      int64_t duration;
+   };
+
+   std::mutex gTraceMutex;
+   std::vector<TraceEvent> gTraceEvents;
+   std::string gTraceFileName;
+   std::chrono::steady_clock::time_point gTraceStart;
+   std::atomic<int> gNextThreadNumber(1);
+
+   //small numbers read better in the trace viewer than hashed thread ids
+   int threadNumber() {
+      static thread_local int number = gNextThreadNumber.fetch_add(1);
+      return number;
+   }
+}
+
+Instrument::Snapshot Instrument::snapshot() {
+   Snapshot snapshot;
+   for(int i=0; i<NumberStages; ++i) {
+      snapshot.stages[i].calls = mCounters[i].calls.load(std::memory_order_relaxed);
+      snapshot.stages[i].pixels = mCounters[i].pixels.load(std::memory_order_relaxed);
+      snapshot.stages[i].cycles = mCounters[i].cycles.load(std::memory_order_relaxed);
+   }
+   return snapshot;
+}
+
+void Instrument::reset() {
+   for(int i=0; i<NumberStages; ++i) {
+      mCounters[i].calls.store(0, std::memory_order_relaxed);
+      mCounters[i].pixels.store(0, std::memory_order_relaxed);
+      mCounters[i].cycles.store(0, std::memory_order_relaxed);
+   }
+}
+
+const char *Instrument::getStageName(Stage stage) {
+   switch(stage) {
+      case StageResampleContributors: return "resample contributors";
+      case StageResampleHorizontal:   return "resample horizontal";
+      case StageResampleVertical:     return "resample vertical";
+      case StageResampleFused:        return "resample fused";
+      case StageBlitUnclipped:        return "blit unclipped";
+      case StageBlitClipped:          return "blit clipped";
+      case StageBlitScaled:           return "blit scaled";
+      case StageBlurRows:             return "blur rows";
+      case StageBlurColumns:          return "blur columns";
+      default:                        return "unknown";
+   }
+}
+
+bool Instrument::startTrace(const char *fileName) {
+   std::lock_guard<std::mutex> lock(gTraceMutex);
+   if(mTracing.load())
+      return false;
+   gTraceFileName = fileName;
+   gTraceEvents.clear();
+   gTraceStart = std::chrono::steady_clock::now();
+   mTracing.store(true);
+   return true;
+}
+
+void Instrument::stopTrace() {
+   std::lock_guard<std::mutex> lock(gTraceMutex);
+   if(!mTracing.load())
+      return;
+   mTracing.store(false);
+
+   FILE *file = fopen(gTraceFileName.c_str(), "w");
+   if(!file)
+      return;
+   fprintf(file, "{\"traceEvents\":[\n");
+   for(size_t i=0; i<gTraceEvents.size(); ++i) {
+      const TraceEvent &event = gTraceEvents[i];
+      fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"imageutils\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}\n",
+              (i == 0) ? "" : ",", getStageName(event.stage), event.thread, (long long)event.start, (long long)event.duration);
+   }
+   fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+   fclose(file);
+   gTraceEvents.clear();
+}
+
+int64_t Instrument::traceTime() {
+   return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - gTraceStart).count();
+}
+
+void Instrument::addTraceEvent(Stage stage, int64_t start, int64_t duration) {
+   TraceEvent event = { stage, threadNumber(), start, duration };
+   std::lock_guard<std::mutex> lock(gTraceMutex);
+   //events of scopes that were still open while the trace stopped are dropped
+   if(mTracing.load())
+      gTraceEvents.push_back(event);
+}
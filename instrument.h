@@ -0,0 +1,119 @@
+
+#ifndef __IMAGEUTILS_INSTRUMENT_H__
+#define __IMAGEUTILS_INSTRUMENT_H__
+
+#include "eastl/types.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+   #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+   #include <x86intrin.h>
+#else
+   #include <chrono>
+#endif
+
+//counters for the hot paths: calls, pixels and cycles per stage. only compiled in with
+//IMAGEUTILS_INSTRUMENT defined (cmake option IMAGEUTILS_INSTRUMENT), otherwise the macros below
+//are empty and snapshot() stays zero. a scope costs two rdtsc and three relaxed atomic adds, so
+//they sit around whole passes and never inside pixel loops.
+//
+//with startTrace() every scope also becomes a complete event ("ph":"X") of a chrome trace file,
+//which chrome://tracing or perfetto can show per thread
+class Instrument {
+public:
+   enum Stage {
+      StageResampleContributors,
+      StageResampleHorizontal,
+      StageResampleVertical,
+      StageResampleFused,        //both passes at once, without the buffer between them
+      StageBlitUnclipped,
+      StageBlitClipped,
+      StageBlitScaled,           //only counted, the blit itself is in one of the two above
+      StageBlurRows,
+      StageBlurColumns,
+      NumberStages
+   };
+
+   struct Counters {
+      uint64_t calls;
+      uint64_t pixels;
+      uint64_t cycles;
+   };
+   struct Snapshot {
+      Counters stages[NumberStages];
+   };
+
+   static Snapshot snapshot();
+   static void reset();
+   static const char *getStageName(Stage stage);
+
+   //trace events are collected in memory and written when the trace stops
+   static bool startTrace(const char *fileName);
+   static void stopTrace();
+
+   static uint64_t readCycles() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+   }
+
+   static void count(Stage stage, uint64_t pixels) {
+      mCounters[stage].calls.fetch_add(1, std::memory_order_relaxed);
+      mCounters[stage].pixels.fetch_add(pixels, std::memory_order_relaxed);
+   }
+
+   class Scope {
+   public:
+      Scope(Stage stage, uint64_t pixels)
+         : mStage(stage), mPixels(pixels), mTraceStart(mTracing.load(std::memory_order_relaxed) ? traceTime() : -1) {
+         mStart = readCycles();
+      }
+      ~Scope() {
+         uint64_t cycles = readCycles() - mStart;
+         count(mStage, mPixels);
+         mCounters[mStage].cycles.fetch_add(cycles, std::memory_order_relaxed);
+         if(mTraceStart >= 0)
+            addTraceEvent(mStage, mTraceStart, traceTime() - mTraceStart);
+      }
+   private:
+      Scope(const Scope &);
+      Scope &operator=(const Scope &);
+
+      Stage mStage;
+      uint64_t mPixels;
+      int64_t mTraceStart;
+      uint64_t mStart;
+   };
+
+private:
+   struct AtomicCounters {
+      std::atomic<uint64_t> calls;
+      std::atomic<uint64_t> pixels;
+      std::atomic<uint64_t> cycles;
+   };
+
+   //microseconds since the trace started
+   static int64_t traceTime();
+   static void addTraceEvent(Stage stage, int64_t start, int64_t duration);
+
+   static AtomicCounters mCounters[NumberStages];
+   static std::atomic<bool> mTracing;
+};
+
+#define IMAGEUTILS_CONCAT2(a, b) a##b
+#define IMAGEUTILS_CONCAT(a, b) IMAGEUTILS_CONCAT2(a, b)
+
+#ifdef IMAGEUTILS_INSTRUMENT
+   //measures until the end of the enclosing block
+   #define IMAGEUTILS_SCOPE(stage, pixels) Instrument::Scope IMAGEUTILS_CONCAT(instrumentScope, __LINE__)(stage, (uint64_t)(pixels))
+   #define IMAGEUTILS_COUNT(stage, pixels) Instrument::count(stage, (uint64_t)(pixels))
+#else
+   #define IMAGEUTILS_SCOPE(stage, pixels)
+   #define IMAGEUTILS_COUNT(stage, pixels)
+#endif
+
+#endif   //#ifndef __IMAGEUTILS_INSTRUMENT_H__
@@ -0,0 +1,318 @@
+
+#ifndef __IMAGEUTILS_REFERENCE_H__
+#define __IMAGEUTILS_REFERENCE_H__
+
+//the plain scalar algorithms as they were before any vector, fixed point or threaded paths were
+//added. faster variants have to match these, see compare(). don't optimize anything in here!
+
+#include "eastl/types.h"
+#include "eastl/extra/fixedpoint.h"
+#include "ImageResize.h"
+#include "softblitter.h"
+#include "stackblur.h"
+#include "image.h"
+
+class Reference {
+public:
+   struct Difference {
+      int maxError;              //biggest difference of a single 8 bit channel
+      int numberDifferent;       //pixels with at least one differing channel
+      int firstX, firstY;        //first differing pixel in row order, -1 if there is none
+      uint32_t expected, actual;
+   };
+
+   //compares two 32 bit views of the same size channel by channel. channels outside of
+   //channelMask are ignored
+   static Difference compare(const ImageView &expected, const ImageView &actual, uint32_t channelMask = 0xffffffff) {
+      Difference diff = { 0, 0, -1, -1, 0, 0 };
+      for(int y=0; y<expected.height; ++y) {
+         const uint32_t *lineExpected = expected.row<uint32_t>(y);
+         const uint32_t *lineActual = actual.row<uint32_t>(y);
+         for(int x=0; x<expected.width; ++x) {
+            uint32_t a = lineExpected[x] & channelMask;
+            uint32_t b = lineActual[x] & channelMask;
+            if(a == b)
+               continue;
+            if(diff.numberDifferent++ == 0) {
+               diff.firstX = x;
+               diff.firstY = y;
+               diff.expected = a;
+               diff.actual = b;
+            }
+            for(int shift=0; shift<32; shift+=8) {
+               int error = (int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff);
+               if(error < 0)
+                  error = -error;
+               if(error > diff.maxError)
+                  diff.maxError = error;
+            }
+         }
+      }
+      return diff;
+   }
+
+   //=== resize: the two pass float filter of ImageResize
+
+   template<class filter> static void resample(const ImageView &input, const ImageView &output) {
+      uint32_t inputSizeX = input.width;
+      uint32_t inputSizeY = input.height;
+      uint32_t outputSizeX = output.width;
+      uint32_t outputSizeY = output.height;
+      uint32_t *work = new uint32_t[outputSizeX * inputSizeY];
+
+      ContributorEntry *contributors = new ContributorEntry[eastl::max(outputSizeX, outputSizeY)];
+
+      calcContributors<filter>(contributors, inputSizeX, outputSizeX, true);
+      for(unsigned int k=0; k<inputSizeY; ++k) {
+         const uint32_t *inputLine = input.row<uint32_t>(k);
+         for(unsigned int i=0; i<outputSizeX; ++i) {
+            float intensity[3] = { 0, 0, 0 };
+            for(int j=0; j<contributors[i].number; ++j)
+               accumulate(intensity, inputLine[contributors[i].p[j].pixelOffset], contributors[i].p[j].weight);
+            work[i+k*outputSizeX] = normalize(intensity, contributors[i].wsum);
+         }
+      }
+      freeContributors(contributors, outputSizeX);
+
+      calcContributors<filter>(contributors, inputSizeY, outputSizeY, false);
+      for(unsigned int k=0; k<outputSizeX; ++k) {
+         for(unsigned int i=0; i<outputSizeY; ++i) {
+            float intensity[3] = { 0, 0, 0 };
+            for(int j=0; j<contributors[i].number; ++j)
+               accumulate(intensity, work[contributors[i].p[j].pixelOffset*outputSizeX + k], contributors[i].p[j].weight);
+            output.row<uint32_t>(i)[k] = normalize(intensity, contributors[i].wsum);
+         }
+      }
+      freeContributors(contributors, outputSizeY);
+
+      delete[] contributors;
+      delete[] work;
+   }
+
+   //the same two passes the other way round, what ImageResize does when isVerticalFirst() says so.
+   //the rounding and clamping between the passes happen at other places than in resample()
+   template<class filter> static void resampleVerticalFirst(const ImageView &input, const ImageView &output) {
+      uint32_t inputSizeX = input.width;
+      uint32_t inputSizeY = input.height;
+      uint32_t outputSizeX = output.width;
+      uint32_t outputSizeY = output.height;
+      uint32_t *work = new uint32_t[inputSizeX * outputSizeY];
+
+      ContributorEntry *contributors = new ContributorEntry[eastl::max(outputSizeX, outputSizeY)];
+
+      calcContributors<filter>(contributors, inputSizeY, outputSizeY, false);
+      for(unsigned int k=0; k<inputSizeX; ++k) {
+         for(unsigned int i=0; i<outputSizeY; ++i) {
+            float intensity[3] = { 0, 0, 0 };
+            for(int j=0; j<contributors[i].number; ++j)
+               accumulate(intensity, input.row<uint32_t>(contributors[i].p[j].pixelOffset)[k], contributors[i].p[j].weight);
+            work[i*inputSizeX + k] = normalize(intensity, contributors[i].wsum);
+         }
+      }
+      freeContributors(contributors, outputSizeY);
+
+      calcContributors<filter>(contributors, inputSizeX, outputSizeX, true);
+      for(unsigned int k=0; k<outputSizeY; ++k) {
+         const uint32_t *workLine = &work[k*inputSizeX];
+         for(unsigned int i=0; i<outputSizeX; ++i) {
+            float intensity[3] = { 0, 0, 0 };
+            for(int j=0; j<contributors[i].number; ++j)
+               accumulate(intensity, workLine[contributors[i].p[j].pixelOffset], contributors[i].p[j].weight);
+            output.row<uint32_t>(k)[i] = normalize(intensity, contributors[i].wsum);
+         }
+      }
+      freeContributors(contributors, outputSizeX);
+
+      delete[] contributors;
+      delete[] work;
+   }
+
+   //=== resize in linear light: the same two passes in double with the exact sRGB curves, the
+   //fixed point of ImageResize::resampleLinear() is within one step of it
+
+   template<class filter> static void resampleLinear(const ImageView &input, const ImageView &output) {
+      uint32_t inputSizeX = input.width;
+      uint32_t inputSizeY = input.height;
+      uint32_t outputSizeX = output.width;
+      uint32_t outputSizeY = output.height;
+      double *work = new double[outputSizeX * inputSizeY * 3];
+
+      ContributorEntry *contributors = new ContributorEntry[eastl::max(outputSizeX, outputSizeY)];
+
+      calcContributors<filter>(contributors, inputSizeX, outputSizeX, true);
+      for(unsigned int k=0; k<inputSizeY; ++k) {
+         const uint32_t *inputLine = input.row<uint32_t>(k);
+         for(unsigned int i=0; i<outputSizeX; ++i) {
+            for(int c=0; c<3; ++c) {
+               double sum = 0;
+               for(int j=0; j<contributors[i].number; ++j) {
+                  uint32_t sourcePixel = inputLine[contributors[i].p[j].pixelOffset];
+                  sum += toLinear((sourcePixel >> (16-c*8)) & 0xff) * contributors[i].p[j].weight;
+               }
+               work[(i+k*outputSizeX)*3 + c] = clampLinear(sum / contributors[i].wsum);
+            }
+         }
+      }
+      freeContributors(contributors, outputSizeX);
+
+      calcContributors<filter>(contributors, inputSizeY, outputSizeY, false);
+      for(unsigned int k=0; k<outputSizeX; ++k) {
+         for(unsigned int i=0; i<outputSizeY; ++i) {
+            uint32_t pixel = 0;
+            for(int c=0; c<3; ++c) {
+               double sum = 0;
+               for(int j=0; j<contributors[i].number; ++j)
+                  sum += work[(contributors[i].p[j].pixelOffset*outputSizeX + k)*3 + c] * contributors[i].p[j].weight;
+               pixel |= (uint32_t)toSRGB(clampLinear(sum / contributors[i].wsum)) << (16-c*8);
+            }
+            output.row<uint32_t>(i)[k] = pixel;
+         }
+      }
+      freeContributors(contributors, outputSizeY);
+
+      delete[] contributors;
+      delete[] work;
+   }
+
+   //=== blit: drawImage with processPixel() for every single pixel
+
+   template<typename PixelTypeSrc, typename PixelTypeDst, class Processor> static
+         void drawImage(Blitter::CopyDescr<PixelTypeSrc> source, Blitter::CopyDescr<PixelTypeDst> dest) {
+      if((dest.posX+dest.width <= 0) || (dest.posX > dest.picWidth))
+         return;
+      if((dest.posY+dest.height <= 0) || (dest.posY > dest.picHeight))
+         return;
+      bool clipping = (dest.posX < 0) || (dest.posY < 0) ||
+                      (dest.posX+dest.width > dest.picWidth) || (dest.posY+dest.height > dest.picHeight);
+
+      //same stepping as the three cases of Blitter::blit()/blitClipped()
+      bool scaleX = (source.width != dest.width);
+      bool scaleY = scaleX || (source.height != dest.height);
+      eastl::FixedPoint32 posX = 0;
+      eastl::FixedPoint32 posY = 0;
+      eastl::FixedPoint32 addX;
+      eastl::FixedPoint32 addY;
+      addX.set((float)source.width / (float)dest.width);
+      addY.set((float)source.height / (float)dest.height);
+
+      if(clipping) {
+         if(dest.posX < 0) {
+            if(scaleX)
+               posX = eastl::FixedPoint32(-dest.posX)*addX;
+            else
+               source.posX += -dest.posX;
+            dest.width -= -dest.posX;
+            dest.posX = 0;
+         }
+         if(dest.posX+dest.width >= dest.picWidth)
+            dest.width -= (dest.posX+dest.width - dest.picWidth);
+         if(dest.posY < 0) {
+            if(scaleY)
+               posY = eastl::FixedPoint32((float)(-dest.posY))*addY;
+            else
+               source.posY += -dest.posY;
+            dest.height -= -dest.posY;
+            dest.posY = 0;
+         }
+         if(dest.posY+dest.height >= dest.picHeight)
+            dest.height -= (dest.posY+dest.height - dest.picHeight);
+      }
+
+      PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+      PixelTypeSrc *src = source.pixel(source.posX, source.posY);
+      for(int y=0; y<dest.height; ++y) {
+         PixelTypeSrc *srcLine = source.addLines(src, scaleY ? (int)posY : y);
+         eastl::FixedPoint32 workX = posX;
+         for(int x=0; x<dest.width; ++x) {
+            Processor::template processPixel<PixelTypeSrc, PixelTypeDst>(srcLine + (scaleX ? (int)workX : x), dst+x);
+            workX += addX;
+         }
+         posY += addY;
+         dst = dest.addLines(dst, 1);
+      }
+   }
+
+   //=== blur: Stackblur::blur() is the scalar reference, it is never dispatched to another kernel
+
+   static void blur(const ImageView &view, int radiusX, int radiusY) {
+      Stackblur::blur(view, radiusX, radiusY);
+   }
+
+private:
+   struct Contributor {
+      int pixelOffset;
+      float weight;
+   };
+   struct ContributorEntry {
+      int number;
+      Contributor *p;
+      float wsum;
+   };
+
+   template<class filter> static void calcContributors(ContributorEntry *contributors, uint32_t inputSize,
+                                                       uint32_t outputSize, bool horizontal) {
+      float scale = (float)outputSize / (float)inputSize;
+      float radius = filter::getDefaultFilterRadius();
+      float wdth = (scale < 1.0f) ? radius / scale : radius;
+      for(unsigned int i=0; i<outputSize; ++i) {
+         contributors[i].number = 0;
+         contributors[i].p = new Contributor[(int)floor(2*wdth+1)];
+         contributors[i].wsum = 0;
+         float center = (i+0.5f)/scale;
+         //horizontal upsampling rounds outwards, the other three cases truncate
+         int left, right;
+         if((scale >= 1.0f) && horizontal) {
+            left = (int)floor(center-wdth);
+            right = (int)ceil(center+wdth);
+         } else {
+            left = (int)(center-wdth);
+            right = (int)(center+wdth);
+         }
+         for(int j=left; j<=right; ++j) {
+            float weight = (scale < 1.0f) ? filter::getValue((center-j-0.5f)*scale) : filter::getValue(center-j-0.5f);
+            if((weight == 0) || (j < 0) || (j >= (signed int)inputSize))
+               continue;
+            contributors[i].p[contributors[i].number].pixelOffset = j;
+            contributors[i].p[contributors[i].number].weight = weight;
+            contributors[i].wsum += weight;
+            contributors[i].number++;
+         }
+      }
+   }
+
+   static void freeContributors(ContributorEntry *contributors, uint32_t size) {
+      for(unsigned int i=0; i<size; ++i)
+         delete[] contributors[i].p;
+   }
+
+   static void accumulate(float *intensity, uint32_t sourcePixel, float weight) {
+      intensity[0] += ((sourcePixel&0x00ff0000) >> 16) * weight;
+      intensity[1] += ((sourcePixel&0x0000ff00) >> 8) * weight;
+      intensity[2] +=  (sourcePixel&0x000000ff) * weight;
+   }
+
+   static double toLinear(uint32_t value) {
+      double c = value/255.0;
+      return (c <= 0.04045) ? c/12.92 : pow((c+0.055)/1.055, 2.4);
+   }
+   static int toSRGB(double linear) {
+      double c = (linear <= 0.0031308) ? linear*12.92 : 1.055*pow(linear, 1/2.4) - 0.055;
+      return (int)floor(c*255 + 0.5);
+   }
+   static double clampLinear(double value) {
+      return (value < 0) ? 0 : ((value > 1) ? 1 : value);
+   }
+
+   static uint32_t normalize(float *intensity, float wsum) {
+      int channel[3];
+      for(int i=0; i<3; ++i) {
+         float value = intensity[i] / wsum;
+         if(value < 0) value = 0;
+         if(value > 255) value = 255;
+         channel[i] = (int)value;
+      }
+      return (channel[0]<<16) | (channel[1]<<8) | channel[2];
+   }
+};
+
+#endif   //#ifndef __IMAGEUTILS_REFERENCE_H__
@@ -0,0 +1,193 @@
+
+#include "resizebatch.h"
+
+ResizeBatch::ResizeBatch()
+   : mUsePyramid(true) {
+}
+
+ResizeBatch::~ResizeBatch() {
+   clearPlans();
+}
+
+void ResizeBatch::clearPlans() {
+   for(size_t i=0; i<mPlans.size(); ++i) {
+      ImageResize::freeContributors(mPlans[i]->contributors, mPlans[i]->outputSize);
+      delete[] mPlans[i]->contributors;
+      delete mPlans[i];
+   }
+   mPlans.clear();
+}
+
+const ResizeBatch::Plan *ResizeBatch::getPlan(ResizeFilter filter, int inputSize, int outputSize, bool horizontal) {
+   for(size_t i=0; i<mPlans.size(); ++i) {
+      const Plan *plan = mPlans[i];
+      if((plan->filter == filter) && (plan->inputSize == inputSize) && (plan->outputSize == outputSize) &&
+         (plan->horizontal == horizontal))
+         return plan;
+   }
+   IMAGEUTILS_SCOPE(Instrument::StageResampleContributors, outputSize);
+   Plan *plan = new Plan;
+   plan->filter = filter;
+   plan->inputSize = inputSize;
+   plan->outputSize = outputSize;
+   plan->horizontal = horizontal;
+   plan->contributors = new ImageResize::ContributorEntry[outputSize];
+   ImageResize::calcContributors(filter, plan->contributors, inputSize, outputSize, horizontal);
+   mPlans.push_back(plan);
+   return plan;
+}
+
+int ResizeBatch::getLevel(int sourceWidth, int sourceHeight, int targetWidth, int targetHeight) {
+   int level = 0;
+   //a 1x1 level doesn't get any smaller, whatever size the target has
+   while(((sourceWidth > 1) || (sourceHeight > 1)) &&
+         ((sourceWidth+1)/2 >= PyramidFactor*targetWidth) && ((sourceHeight+1)/2 >= PyramidFactor*targetHeight)) {
+      sourceWidth = (sourceWidth+1)/2;
+      sourceHeight = (sourceHeight+1)/2;
+      level++;
+   }
+   return level;
+}
+
+//one horizontal pass of a level, shared by all targets with the same filter and width
+struct HorizontalPass {
+   int level;
+   ResizeFilter filter;
+   int width;
+   const ImageResize::ContributorEntry *contributors;
+   Image work;
+};
+
+void ResizeBatch::resample(Executor &executor, const ImageView &source, const Target *targets, int numberTargets) {
+   if((numberTargets <= 0) || source.isEmpty() || !source.is32Bit())
+      return;
+   for(int t=0; t<numberTargets; ++t) {
+      if(!targets[t].output.is32Bit())
+         return;
+   }
+   if(mPlans.size() > MaxPlans)
+      clearPlans();
+   const ImageResize::Kernels &kernels = ImageResize::getKernels();
+
+   //the levels of the pyramid, the source is the first one
+   std::vector<int> targetLevels(numberTargets);
+   int numberLevels = 1;
+   for(int t=0; t<numberTargets; ++t) {
+      const ImageView &output = targets[t].output;
+      targetLevels[t] = (mUsePyramid && !output.isEmpty()) ? getLevel(source.width, source.height, output.width, output.height) : 0;
+      numberLevels = eastl::max(numberLevels, targetLevels[t]+1);
+   }
+   std::vector<Image> levelImages(numberLevels);
+   std::vector<ImageView> levels(numberLevels);
+   levels[0] = source;
+   for(int l=1; l<numberLevels; ++l) {
+      levelImages[l].create((levels[l-1].width+1)/2, (levels[l-1].height+1)/2);
+      levels[l] = levelImages[l].view();
+   }
+
+   //the horizontal passes and the plans of all targets, before anything runs. targets that filter
+   //vertically first, like resample() would, have no shared pass and keep their own plan
+   std::vector<HorizontalPass> horizontals;
+   horizontals.reserve(numberTargets);
+   std::vector<int> targetHorizontals(numberTargets);
+   std::vector<const Plan*> horizontalPlans(numberTargets);
+   std::vector<const Plan*> verticalPlans(numberTargets);
+   for(int t=0; t<numberTargets; ++t) {
+      const Target &target = targets[t];
+      const ImageView &input = levels[targetLevels[t]];
+      //empty targets are skipped
+      if(target.output.isEmpty()) {
+         targetHorizontals[t] = -1;
+         horizontalPlans[t] = nullptr;
+         verticalPlans[t] = nullptr;
+         continue;
+      }
+      verticalPlans[t] = getPlan(target.filter, input.height, target.output.height, false);
+      if(ImageResize::isVerticalFirst(input.width, input.height, target.output.width, target.output.height,
+                                      target.filter)) {
+         targetHorizontals[t] = -1;
+         horizontalPlans[t] = getPlan(target.filter, input.width, target.output.width, true);
+         continue;
+      }
+      size_t h = 0;
+      while((h < horizontals.size()) && ((horizontals[h].level != targetLevels[t]) ||
+            (horizontals[h].filter != target.filter) || (horizontals[h].width != target.output.width)))
+         ++h;
+      if(h == horizontals.size()) {
+         horizontals.push_back(HorizontalPass());
+         HorizontalPass &pass = horizontals.back();
+         pass.level = targetLevels[t];
+         pass.filter = target.filter;
+         pass.width = target.output.width;
+         pass.contributors = getPlan(target.filter, input.width, target.output.width, true)->contributors;
+         pass.work.create(target.output.width, input.height);
+      }
+      targetHorizontals[t] = (int)h;
+   }
+
+   //level by level: the horizontal passes of the level and the halving into the next one, both in
+   //the same bands. a band of a level that is halved has an even number of rows
+   for(int l=0; l<numberLevels; ++l) {
+      const ImageView &input = levels[l];
+      bool halving = (l+1 < numberLevels);
+      int rowsPerUnit = halving ? 2 : 1;
+      int units = (input.height + rowsPerUnit-1) / rowsPerUnit;
+#ifdef IMAGEUTILS_INSTRUMENT
+      //the pixels written by the horizontal passes of the level, the halving isn't counted
+      int64_t written = 0;
+      for(size_t h=0; h<horizontals.size(); ++h) {
+         if(horizontals[h].level == l)
+            written += (int64_t)horizontals[h].width*input.height;
+      }
+#endif
+      IMAGEUTILS_SCOPE(Instrument::StageResampleHorizontal, written);
+      int parts = executor.getNumberJobs(units, ImageResize::MinimumRows);
+      executor.run(parts, [&](int part) {
+         int begin = Executor::partBegin(0, units, parts, part);
+         int end = Executor::partBegin(0, units, parts, part+1);
+         int rowBegin = begin*rowsPerUnit;
+         int rowEnd = eastl::min(end*rowsPerUnit, input.height);
+         for(size_t h=0; h<horizontals.size(); ++h) {
+            const HorizontalPass &pass = horizontals[h];
+            if(pass.level != l)
+               continue;
+            for(int k=rowBegin; k<rowEnd; ++k)
+               kernels.filterRow(input.row<uint32_t>(k), pass.contributors, pass.work.row<uint32_t>(k), pass.width);
+         }
+         if(halving)
+            ImageResize::halve(input.crop(0, rowBegin, input.width, rowEnd-rowBegin),
+                               levels[l+1].crop(0, begin, levels[l+1].width, end-begin));
+      });
+   }
+
+   //all targets at once, each of them split into bands again. targets that go vertical first count
+   //their output in resamplePasses() as well
+#ifdef IMAGEUTILS_INSTRUMENT
+   int64_t outputPixels = 0;
+   for(int t=0; t<numberTargets; ++t) {
+      if(!targets[t].output.isEmpty())
+         outputPixels += (int64_t)targets[t].output.width*targets[t].output.height;
+   }
+#endif
+   IMAGEUTILS_SCOPE(Instrument::StageResampleVertical, outputPixels);
+   executor.run(numberTargets, [&](int t) {
+      const ImageView &output = targets[t].output;
+      if(output.isEmpty())
+         return;
+      if(targetHorizontals[t] < 0) {
+         ImageResize::resamplePasses(executor, levels[targetLevels[t]], horizontalPlans[t]->contributors,
+                                     verticalPlans[t]->contributors, true, output);
+         return;
+      }
+      const HorizontalPass &pass = horizontals[targetHorizontals[t]];
+      const ImageResize::ContributorEntry *contributors = verticalPlans[t]->contributors;
+      const uint32_t *work = pass.work.row<uint32_t>(0);
+      ptrdiff_t workPitch = pass.work.view().pitch();
+      int parts = executor.getNumberJobs(output.height, ImageResize::MinimumRows);
+      executor.run(parts, [&](int part) {
+         int end = Executor::partBegin(0, output.height, parts, part+1);
+         for(int i=Executor::partBegin(0, output.height, parts, part); i<end; ++i)
+            kernels.filterColumns(work, workPitch, contributors[i], output.row<uint32_t>(i), output.width);
+      });
+   });
+}
@@ -0,0 +1,63 @@
+
+#ifndef __IMAGEUTILS_RESIZEBATCH_H__
+#define __IMAGEUTILS_RESIZEBATCH_H__
+
+#include "eastl/types.h"
+#include "ImageResize.h"
+#include "threadpool.h"
+
+#include <vector>
+
+//makes several resized versions of one source in one go, all thumbnail sizes of a picture for
+//example. targets with the same width and filter share one horizontal pass, the contributor
+//tables are kept from call to call, and targets far below the source size are resampled from a
+//halved version of it. the source is read once: every band of it goes through the horizontal
+//passes of all targets and through the first halving while it is still in the cache. a target
+//that ImageResize::isVerticalFirst() sends down the other order is resampled on its own
+class ResizeBatch {
+public:
+   struct Target {
+      //32 bit, allocated by the caller, its size is the target size. an empty view is skipped
+      ImageView output;
+      ResizeFilter filter;
+   };
+
+   ResizeBatch();
+   ~ResizeBatch();
+
+   //bands of rows of every pass run as jobs of the executor. without the pyramid every target
+   //gets exactly what ImageResize::resample() gives
+   void resample(Executor &executor, const ImageView &source, const Target *targets, int numberTargets);
+
+   //on by default. when off, every target is resampled from the source itself
+   void setUsePyramid(bool usePyramid) { mUsePyramid = usePyramid; }
+   bool getUsePyramid() const { return mUsePyramid; }
+
+   //the pyramid level a target is resampled from, 0 is the source. the smallest level that still
+   //has PyramidFactor pixels per target pixel on both axes
+   static int getLevel(int sourceWidth, int sourceHeight, int targetWidth, int targetHeight);
+
+   void clearPlans();
+
+   enum { PyramidFactor = 2 };
+   //more contributor tables than this are dropped at the start of the next resample()
+   enum { MaxPlans = 64 };
+
+private:
+   ResizeBatch(const ResizeBatch &);
+   ResizeBatch &operator=(const ResizeBatch &);
+
+   //the contributor table of one axis
+   struct Plan {
+      ResizeFilter filter;
+      int inputSize, outputSize;
+      bool horizontal;
+      ImageResize::ContributorEntry *contributors;
+   };
+   const Plan *getPlan(ResizeFilter filter, int inputSize, int outputSize, bool horizontal);
+
+   std::vector<Plan*> mPlans;
+   bool mUsePyramid;
+};
+
+#endif   //#ifndef __IMAGEUTILS_RESIZEBATCH_H__
@@ -0,0 +1,25 @@
+
+#ifndef __IMAGEUTILS_SIMD_H__
+#define __IMAGEUTILS_SIMD_H__
+
+//which vector instruction sets the kernels can be compiled for. sse2 is part of every x86-64 cpu,
+//the avx2 kernels are compiled with a target attribute so the rest of the library keeps its
+//baseline flags. only call an avx2 kernel when the cpu supports it!
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+   #define IMAGEUTILS_SSE2 1
+   #include <emmintrin.h>
+
+   #if defined(_MSC_VER) || defined(__GNUC__)
+      #define IMAGEUTILS_AVX2 1
+      #include <immintrin.h>
+   #endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+   #define IMAGEUTILS_TARGET_AVX2
+#else
+   #define IMAGEUTILS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#endif   //#ifndef __IMAGEUTILS_SIMD_H__
@@ -1,2 +1,114 @@
 
 #include "softblitter.h"
+#include "simd.h"
+
+//=== scalar kernels
+
+static void blendLineScalar(const uint32_t *src, uint32_t *dest, size_t numberPixels) {
+   for(size_t i=0; i<numberPixels; ++i)
+      Blitter::BlendPixelFullTransparence::pixelBlend(dest[i], src[i]);
+}
+
+static void grayLineScalar(const uint32_t *src, uint32_t *dest, size_t numberPixels, int shift) {
+   for(size_t i=0; i<numberPixels; ++i) {
+      uint32_t val = src[i] >> shift;
+      dest[i] = 0xff000000 | (val<<16) | (val<<8) | val;
+   }
+}
+
+#ifdef IMAGEUTILS_SSE2
+//=== sse2: four pixels per register, the same wrapping 32 bit arithmetic as pixelBlend()
+
+//sse2 has no 32 bit multiply keeping the low half, do the even and odd lanes separately
+static inline __m128i mulLow32(__m128i a, __m128i b) {
+   __m128i even = _mm_mul_epu32(a, b);
+   __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+   return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i pixelBlendSSE2(__m128i d, __m128i s) {
+   const __m128i maskRB = _mm_set1_epi32(0xFF00FF);
+   const __m128i maskG = _mm_set1_epi32(0xFF00);
+   __m128i a = _mm_add_epi32(_mm_srli_epi32(s, 24), _mm_set1_epi32(1));
+   __m128i dstrb = _mm_and_si128(d, maskRB);
+   __m128i dstg = _mm_and_si128(d, maskG);
+   __m128i drb = _mm_srli_epi32(mulLow32(_mm_sub_epi32(_mm_and_si128(s, maskRB), dstrb), a), 8);
+   __m128i dg = _mm_srli_epi32(mulLow32(_mm_sub_epi32(_mm_and_si128(s, maskG), dstg), a), 8);
+   return _mm_or_si128(_mm_and_si128(_mm_add_epi32(drb, dstrb), maskRB), _mm_and_si128(_mm_add_epi32(dg, dstg), maskG));
+}
+
+static void blendLineSSE2(const uint32_t *src, uint32_t *dest, size_t numberPixels) {
+   size_t i = 0;
+   for(; i+4<=numberPixels; i+=4) {
+      __m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+      __m128i d = _mm_loadu_si128((const __m128i*)&dest[i]);
+      _mm_storeu_si128((__m128i*)&dest[i], pixelBlendSSE2(d, s));
+   }
+   blendLineScalar(src+i, dest+i, numberPixels-i);
+}
+
+static void grayLineSSE2(const uint32_t *src, uint32_t *dest, size_t numberPixels, int shift) {
+   const __m128i count = _mm_cvtsi32_si128(shift);
+   const __m128i alpha = _mm_set1_epi32(0xff000000);
+   size_t i = 0;
+   for(; i+4<=numberPixels; i+=4) {
+      __m128i val = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)&src[i]), count);
+      __m128i gray = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(val, 16), _mm_slli_epi32(val, 8)), val);
+      _mm_storeu_si128((__m128i*)&dest[i], _mm_or_si128(gray, alpha));
+   }
+   grayLineScalar(src+i, dest+i, numberPixels-i, shift);
+}
+#endif
+
+#ifdef IMAGEUTILS_AVX2
+//=== avx2: eight pixels per register
+
+IMAGEUTILS_TARGET_AVX2 static void blendLineAVX2(const uint32_t *src, uint32_t *dest, size_t numberPixels) {
+   const __m256i maskRB = _mm256_set1_epi32(0xFF00FF);
+   const __m256i maskG = _mm256_set1_epi32(0xFF00);
+   const __m256i one = _mm256_set1_epi32(1);
+   size_t i = 0;
+   for(; i+8<=numberPixels; i+=8) {
+      __m256i s = _mm256_loadu_si256((const __m256i*)&src[i]);
+      __m256i d = _mm256_loadu_si256((const __m256i*)&dest[i]);
+      __m256i a = _mm256_add_epi32(_mm256_srli_epi32(s, 24), one);
+      __m256i dstrb = _mm256_and_si256(d, maskRB);
+      __m256i dstg = _mm256_and_si256(d, maskG);
+      __m256i drb = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_and_si256(s, maskRB), dstrb), a), 8);
+      __m256i dg = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_and_si256(s, maskG), dstg), a), 8);
+      __m256i result = _mm256_or_si256(_mm256_and_si256(_mm256_add_epi32(drb, dstrb), maskRB),
+                                       _mm256_and_si256(_mm256_add_epi32(dg, dstg), maskG));
+      _mm256_storeu_si256((__m256i*)&dest[i], result);
+   }
+   blendLineSSE2(src+i, dest+i, numberPixels-i);
+}
+
+IMAGEUTILS_TARGET_AVX2 static void grayLineAVX2(const uint32_t *src, uint32_t *dest, size_t numberPixels, int shift) {
+   const __m128i count = _mm_cvtsi32_si128(shift);
+   const __m256i alpha = _mm256_set1_epi32(0xff000000);
+   size_t i = 0;
+   for(; i+8<=numberPixels; i+=8) {
+      __m256i val = _mm256_srl_epi32(_mm256_loadu_si256((const __m256i*)&src[i]), count);
+      __m256i gray = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(val, 16), _mm256_slli_epi32(val, 8)), val);
+      _mm256_storeu_si256((__m256i*)&dest[i], _mm256_or_si256(gray, alpha));
+   }
+   grayLineSSE2(src+i, dest+i, numberPixels-i, shift);
+}
+#endif
+
+//=== dispatch
+
+const Blitter::Kernels &Blitter::getKernels(CpuLevel level) {
+   static const Kernels scalar = { blendLineScalar, grayLineScalar };
+#ifdef IMAGEUTILS_SSE2
+   static const Kernels sse2 = { blendLineSSE2, grayLineSSE2 };
+   if(level == CpuLevelSSE2)
+      return sse2;
+#endif
+#ifdef IMAGEUTILS_AVX2
+   static const Kernels avx2 = { blendLineAVX2, grayLineAVX2 };
+   if(level >= CpuLevelAVX2)
+      return avx2;
+#endif
+   return scalar;
+}
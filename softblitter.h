@@ -4,18 +4,53 @@
 
 #include "eastl/types.h"
 #include "eastl/extra/fixedpoint.h"
+#include "image.h"
+#include "instrument.h"
+#include "cpufeatures.h"
+#include "threadpool.h"
 #include <memory.h>
 
 class Blitter {
 public:
+   //the line loops of the processors that are worth vectorizing, one table per cpu level.
+   //every kernel gives exactly the result of the processPixel() loop
+   struct Kernels {
+      void (*blendLine)(const uint32_t *src, uint32_t *dest, size_t numberPixels);
+      void (*grayLine)(const uint32_t *src, uint32_t *dest, size_t numberPixels, int shift);
+   };
+   static const Kernels &getKernels(CpuLevel level);
+   static const Kernels &getKernels() { return getKernels(CpuFeatures::getLevel()); }
+
    template<typename PixelType> struct CopyDescr {
       int posX, posY;
       int width, height;
       PixelType *data;
       int picWidth, picHeight;
+      int stride = 0;                              //bytes between two lines, 0 for picWidth pixels
+      PixelFormat format = PixelFormatARGB8888;
       void set(int x, int y, int w, int h) {
          posX = x; posY = y; width = w; height = h;
       }
+      //the whole view becomes the picture, crops of other pictures work without copying. see
+      //matches() for the format
+      void setView(const ImageView &view) {
+         data = (PixelType*)view.data; picWidth = view.width; picHeight = view.height;
+         stride = (int)view.stride; format = view.format;
+      }
+      ptrdiff_t lineStride() const {
+         return (stride != 0) ? stride : (ptrdiff_t)picWidth*sizeof(PixelType);
+      }
+      PixelType *addLines(PixelType *pointer, int lines) const {
+         return (PixelType*)((uint8_t*)pointer + lines*lineStride());
+      }
+      PixelType *pixel(int x, int y) const {
+         return addLines(data, y) + x;
+      }
+      //the pixels of the view are PixelType and its stride is a whole number of them
+      static bool matches(const ImageView &view) {
+         return (bytesPerPixel(view.format) == (int)sizeof(PixelType)) &&
+                (view.stride % (ptrdiff_t)sizeof(PixelType) == 0);
+      }
    };
 
    //=== the pixel processors
@@ -43,14 +78,9 @@ public:
       }
       template<typename PixelTypeSrc, typename PixelTypeDst> static
             void processLine(PixelTypeSrc *src, PixelTypeDst *dest, size_t numberPixels) {
-         //is this specialization needed?
          static_assert(sizeof(PixelTypeSrc) == 4, "pixel types in wrong format");
          static_assert(sizeof(PixelTypeSrc) == 4, "pixel types in wrong format");
-         for(unsigned int i=0; i<numberPixels; ++i) {
-            uint32_t val = (*src) >> shift;
-            ++src;
-            *(dest++) = 0xff000000 | (val<<16) | (val<<8) | val;
-         }
+         getKernels().grayLine((const uint32_t*)src, (uint32_t*)dest, numberPixels, shift);
       }
    };
 
@@ -86,14 +116,9 @@ public:
       }
       template<typename PixelTypeSrc, typename PixelTypeDst> static
             void processLine(PixelTypeSrc *src, PixelTypeDst *dest, size_t numberPixels) {
-         //is this specialization needed?
          static_assert(sizeof(PixelTypeSrc) == 4, "pixel types in wrong format");
          static_assert(sizeof(PixelTypeSrc) == 4, "pixel types in wrong format");
-         for(unsigned int i=0; i<numberPixels; ++i) {
-            pixelBlend(*src, *dest);
-            ++src;
-            ++dest;
-         }
+         getKernels().blendLine((const uint32_t*)src, (uint32_t*)dest, numberPixels);
       }
    };
 
@@ -128,25 +153,25 @@ public:
       if(source.width == dest.width) {
          if(source.height == dest.height) {
             //hier reicht kopieren
-            PixelTypeDst *dst = dest.data+dest.posX+dest.posY*dest.picWidth;
-            PixelTypeSrc *src = source.data+source.posX+source.posY*source.picWidth;
+            PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+            PixelTypeSrc *src = source.pixel(source.posX, source.posY);
             for(int y=0; y<dest.height; ++y) {
-               Processor::processLine<PixelTypeSrc, PixelTypeDst>(src, dst, dest.width);
-               dst += dest.picWidth;
-               src += source.picWidth;
+               Processor::template processLine<PixelTypeSrc, PixelTypeDst>(src, dst, dest.width);
+               dst = dest.addLines(dst, 1);
+               src = source.addLines(src, 1);
             }
          } else {
             //bild nur horizontal skalieren
             eastl::FixedPoint32 posY = 0;
             eastl::FixedPoint32 addY;
             addY.set((float)source.height / (float)dest.height);
-            PixelTypeDst *dst = dest.data+dest.posX+dest.posY*dest.picWidth;
-            PixelTypeSrc *src = source.data+source.posX+source.posY*source.picWidth;
+            PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+            PixelTypeSrc *src = source.pixel(source.posX, source.posY);
             for(int y=0; y<dest.height; ++y) {
-               PixelTypeSrc *srcLine = src+((int)posY)*source.picWidth;
-               Processor::processLine<PixelTypeSrc, PixelTypeDst>(srcLine, dst, dest.width);
+               PixelTypeSrc *srcLine = source.addLines(src, (int)posY);
+               Processor::template processLine<PixelTypeSrc, PixelTypeDst>(srcLine, dst, dest.width);
                posY += addY;
-               dst += dest.picWidth;
+               dst = dest.addLines(dst, 1);
             }
          }
       } else {
@@ -157,19 +182,19 @@ public:
          eastl::FixedPoint32 addY;
          addX.set((float)source.width / (float)dest.width);
          addY.set((float)source.height / (float)dest.height);
-         PixelTypeDst *dst = dest.data+dest.posX+dest.posY*dest.picWidth;
-         PixelTypeSrc *src = source.data+source.posX+source.posY*source.picWidth;
+         PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+         PixelTypeSrc *src = source.pixel(source.posX, source.posY);
          for(int y=0; y<dest.height; ++y) {
-            PixelTypeSrc *srcLine = src+((int)posY)*source.picWidth;
+            PixelTypeSrc *srcLine = source.addLines(src, (int)posY);
             eastl::FixedPoint32 workX = posX;
             PixelTypeDst *workDst = dst;
             for(int x=0; x<dest.width; ++x) {
-               Processor::processPixel<PixelTypeSrc, PixelTypeDst>(srcLine+((int)workX), workDst);
+               Processor::template processPixel<PixelTypeSrc, PixelTypeDst>(srcLine+((int)workX), workDst);
                workX += addX;
                ++workDst;
             }
             posY += addY;
-            dst += dest.picWidth;
+            dst = dest.addLines(dst, 1);
          }
       }
    }
@@ -196,12 +221,12 @@ public:
                dest.height -= (dest.posY+dest.height - dest.picHeight);
             }
 
-            PixelTypeDst *dst = dest.data+dest.posX+dest.posY*dest.picWidth;
-            PixelTypeSrc *src = source.data+source.posX+source.posY*source.picWidth;
+            PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+            PixelTypeSrc *src = source.pixel(source.posX, source.posY);
             for(int y=0; y<dest.height; ++y) {
-               Processor::processLine<PixelTypeSrc, PixelTypeDst>(src, dst, dest.width);
-               dst += dest.picWidth;
-               src += source.picWidth;
+               Processor::template processLine<PixelTypeSrc, PixelTypeDst>(src, dst, dest.width);
+               dst = dest.addLines(dst, 1);
+               src = source.addLines(src, 1);
             }
          } else {
             //bild nur horizontal skalieren
@@ -226,13 +251,13 @@ public:
                dest.height -= (dest.posY+dest.height - dest.picHeight);
             }
 
-            PixelTypeDst *dst = dest.data+dest.posX+dest.posY*dest.picWidth;
-            PixelTypeSrc *src = source.data+source.posX+source.posY*source.picWidth;
+            PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+            PixelTypeSrc *src = source.pixel(source.posX, source.posY);
             for(int y=0; y<dest.height; ++y) {
-               PixelTypeSrc *srcLine = src+((int)posY)*source.picWidth;
-               Processor::processLine<PixelTypeSrc, PixelTypeDst>(srcLine, dst, dest.width);
+               PixelTypeSrc *srcLine = source.addLines(src, (int)posY);
+               Processor::template processLine<PixelTypeSrc, PixelTypeDst>(srcLine, dst, dest.width);
                posY += addY;
-               dst += dest.picWidth;
+               dst = dest.addLines(dst, 1);
             }
          }
       } else {
@@ -261,19 +286,19 @@ public:
             dest.height -= (dest.posY+dest.height - dest.picHeight);
          }
 
-         PixelTypeDst *dst = dest.data+dest.posX+dest.posY*dest.picWidth;
-         PixelTypeSrc *src = source.data+source.posX+source.posY*source.picWidth;
+         PixelTypeDst *dst = dest.pixel(dest.posX, dest.posY);
+         PixelTypeSrc *src = source.pixel(source.posX, source.posY);
          for(int y=0; y<dest.height; ++y) {
-            PixelTypeSrc *srcLine = src+((int)posY)*source.picWidth;
+            PixelTypeSrc *srcLine = source.addLines(src, (int)posY);
             eastl::FixedPoint32 workX = posX;
             PixelTypeDst *workDst = dst;
             for(int x=0; x<dest.width; ++x) {
-               Processor::processPixel<PixelTypeSrc, PixelTypeDst>(srcLine+((int)workX), workDst);
+               Processor::template processPixel<PixelTypeSrc, PixelTypeDst>(srcLine+((int)workX), workDst);
                workX += addX;
                ++workDst;
             }
             posY += addY;
-            dst += dest.picWidth;
+            dst = dest.addLines(dst, 1);
          }
       }
    }
@@ -302,10 +327,62 @@ public:
       if(dest.posY+dest.height > dest.picHeight)
          clipping = true;
 
-      if(clipping)
+      if((source.width != dest.width) || (source.height != dest.height)) {
+         IMAGEUTILS_COUNT(Instrument::StageBlitScaled, visiblePixels(dest));
+      }
+      if(clipping) {
+         IMAGEUTILS_SCOPE(Instrument::StageBlitClipped, visiblePixels(dest));
          blitClipped<PixelTypeSrc, PixelTypeDst, Processor>(source, dest);
-      else
+      } else {
+         IMAGEUTILS_SCOPE(Instrument::StageBlitUnclipped, visiblePixels(dest));
          blit<PixelTypeSrc, PixelTypeDst, Processor>(source, dest);
+      }
+   }
+
+   //pixels of the destination rectangle that end up inside the picture
+   template<typename PixelType> static int visiblePixels(const CopyDescr<PixelType> &dest) {
+      int width = eastl::min(dest.posX+dest.width, dest.picWidth) - eastl::max(dest.posX, 0);
+      int height = eastl::min(dest.posY+dest.height, dest.picHeight) - eastl::max(dest.posY, 0);
+      return ((width > 0) && (height > 0)) ? width*height : 0;
+   }
+
+   //drawImage() with the visible rows of the destination split into bands that run as jobs of the
+   //executor. every band is drawn as a clipped blit into its part of the picture, the source lines
+   //come out the same as when drawing everything at once
+   template<typename PixelTypeSrc, typename PixelTypeDst, class Processor> static
+         void drawImage(Executor &executor, const CopyDescr<PixelTypeSrc> &source, const CopyDescr<PixelTypeDst> &dest) {
+      int rowsBegin = eastl::max(dest.posY, 0);
+      int rowsEnd = eastl::min(dest.posY+dest.height, dest.picHeight);
+      if(rowsEnd <= rowsBegin)
+         return;
+      int parts = executor.getNumberJobs(rowsEnd-rowsBegin, MinimumRows);
+      executor.run(parts, [&](int part) {
+         int bandBegin = Executor::partBegin(rowsBegin, rowsEnd, parts, part);
+         int bandEnd = Executor::partBegin(rowsBegin, rowsEnd, parts, part+1);
+         CopyDescr<PixelTypeSrc> src = source;
+         CopyDescr<PixelTypeDst> band = dest;
+         band.data = dest.addLines(dest.data, bandBegin);
+         band.picHeight = bandEnd-bandBegin;
+         band.posY = dest.posY-bandBegin;
+         drawImage<PixelTypeSrc, PixelTypeDst, Processor>(src, band);
+      });
+   }
+
+   //rows of the smallest band of a parallel drawImage()
+   enum { MinimumRows = 8 };
+
+   //draws the whole source view into [x, x+w) x [y, y+h) of the destination view
+   template<typename PixelTypeSrc, typename PixelTypeDst, class Processor> static
+         void drawImage(const ImageView &source, const ImageView &dest, int x, int y, int w, int h) {
+      if(!CopyDescr<PixelTypeSrc>::matches(source) || !CopyDescr<PixelTypeDst>::matches(dest))
+         return;
+      CopyDescr<PixelTypeSrc> src;
+      src.setView(source);
+      src.set(0, 0, source.width, source.height);
+      CopyDescr<PixelTypeDst> dst;
+      dst.setView(dest);
+      dst.set(x, y, w, h);
+      drawImage<PixelTypeSrc, PixelTypeDst, Processor>(src, dst);
    }
 };
 
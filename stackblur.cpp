@@ -1,5 +1,9 @@
 
 #include "stackblur.h"
+#include "threadpool.h"
+#include "ImageResize.h"
+#include "instrument.h"
+#include <memory.h>
 
 uint16_t const Stackblur::mMulTable[255] = {
      512,512,456,512,328,456,335,512,405,328,271,456,388,335,292,512,
@@ -37,3 +41,610 @@ uint8_t const Stackblur::mShiftTable[255] = {
       24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
       24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24
 };
+
+//=== the line kernels
+//a line is blurred with a moving stack of 2*radius+1 pixels. the sums are kept unsigned 32 bit
+//like in the agg-version, the multiplication tables are chosen so that they never overflow
+
+static inline uint32_t clearAlpha(uint32_t pixel) {
+   return pixel & 0x00ffffff;
+}
+
+static void blurLine(const uint32_t *src, ptrdiff_t srcStep, uint32_t *dst, ptrdiff_t dstStep, int length,
+                     int begin, int end, int radius, uint32_t multiplicator, uint32_t shift, uint32_t *stack) {
+   int div = radius+radius+1;
+   int last = length-1;
+
+   uint32_t redSum = 0, greenSum = 0, blueSum = 0;
+   uint32_t redInSum = 0, greenInSum = 0, blueInSum = 0;
+   uint32_t redOutSum = 0, greenOutSum = 0, blueOutSum = 0;
+
+   for(int i=-radius; i<=radius; i++) {
+      int xp = begin+i;
+      if(xp < 0)
+         xp = 0;
+      if(xp > last)
+         xp = last;
+      uint32_t pixel = clearAlpha(src[xp*srcStep]);
+      uint32_t red   = (pixel & 0x00ff0000) >> 16;
+      uint32_t green = (pixel & 0x0000ff00) >> 8;
+      uint32_t blue  = pixel & 0x000000ff;
+      stack[i+radius] = pixel;
+
+      uint32_t weight = radius+1-(i < 0 ? -i : i);
+      redSum   += red*weight;
+      greenSum += green*weight;
+      blueSum  += blue*weight;
+      if(i <= 0) {
+         redOutSum   += red;
+         greenOutSum += green;
+         blueOutSum  += blue;
+      } else {
+         redInSum   += red;
+         greenInSum += green;
+         blueInSum  += blue;
+      }
+   }
+
+   int stackpointer = radius;
+   int xp = begin+radius;
+   if(xp > last)
+      xp = last;
+
+   for(int x=begin; x<end; x++) {
+      uint32_t red   = ((redSum   * multiplicator) >> shift) & 0xff;
+      uint32_t green = ((greenSum * multiplicator) >> shift) & 0xff;
+      uint32_t blue  = ((blueSum  * multiplicator) >> shift) & 0xff;
+      dst[x*dstStep] = (red<<16) + (green<<8) + blue;
+
+      redSum   -= redOutSum;
+      greenSum -= greenOutSum;
+      blueSum  -= blueOutSum;
+
+      int stackStart = stackpointer + div - radius;
+      if(stackStart >= div)
+         stackStart -= div;
+
+      uint32_t pixel = stack[stackStart];
+      redOutSum   -= (pixel & 0x00ff0000) >> 16;
+      greenOutSum -= (pixel & 0x0000ff00) >> 8;
+      blueOutSum  -= pixel & 0x000000ff;
+
+      if(xp < last)
+         xp++;
+
+      pixel = clearAlpha(src[xp*srcStep]);
+      stack[stackStart] = pixel;
+
+      redInSum   += (pixel & 0x00ff0000) >> 16;
+      greenInSum += (pixel & 0x0000ff00) >> 8;
+      blueInSum  += pixel & 0x000000ff;
+
+      redSum   += redInSum;
+      greenSum += greenInSum;
+      blueSum  += blueInSum;
+
+      stackpointer++;
+      if(stackpointer >= div)
+         stackpointer = 0;
+
+      pixel = stack[stackpointer];
+      red   = (pixel & 0x00ff0000) >> 16;
+      green = (pixel & 0x0000ff00) >> 8;
+      blue  = pixel & 0x000000ff;
+
+      redOutSum   += red;
+      greenOutSum += green;
+      blueOutSum  += blue;
+
+      redInSum   -= red;
+      greenInSum -= green;
+      blueInSum  -= blue;
+   }
+}
+
+#ifdef IMAGEUTILS_SSE2
+//the four channels of a pixel live in the four 32 bit lanes of a register, alpha stays zero
+
+static inline __m128i unpackPixel(uint32_t pixel) {
+   __m128i zero = _mm_setzero_si128();
+   __m128i bytes = _mm_cvtsi32_si128((int)clearAlpha(pixel));
+   return _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+}
+
+//(sum*multiplicator) >> shift on unsigned 32 bit lanes, sse2 has no 32 bit multiply so the
+//lanes are multiplied in two 64 bit halves and the low words put back together
+static inline __m128i mulShift(__m128i sum, __m128i multiplicator, __m128i shift) {
+   __m128i even = _mm_mul_epu32(sum, multiplicator);
+   __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(sum, 32), multiplicator);
+   even = _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0));
+   odd  = _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0));
+   return _mm_srl_epi32(_mm_unpacklo_epi32(even, odd), shift);
+}
+
+static inline uint32_t packPixel(__m128i channels) {
+   channels = _mm_and_si128(channels, _mm_set1_epi32(0xff));
+   channels = _mm_packs_epi32(channels, channels);
+   return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(channels, channels));
+}
+
+static void blurLineSSE2(const uint32_t *src, ptrdiff_t srcStep, uint32_t *dst, ptrdiff_t dstStep, int length,
+                         int begin, int end, int radius, uint32_t multiplicator, uint32_t shift, uint32_t *stack) {
+   int div = radius+radius+1;
+   int last = length-1;
+   __m128i mul = _mm_set1_epi32((int)multiplicator);
+   __m128i shiftCount = _mm_cvtsi32_si128((int)shift);
+   __m128i *stackVec = (__m128i*)stack;
+
+   __m128i sum = _mm_setzero_si128();
+   __m128i inSum = _mm_setzero_si128();
+   __m128i outSum = _mm_setzero_si128();
+
+   for(int i=-radius; i<=radius; i++) {
+      int xp = begin+i;
+      if(xp < 0)
+         xp = 0;
+      if(xp > last)
+         xp = last;
+      __m128i pixel = unpackPixel(src[xp*srcStep]);
+      _mm_storeu_si128(stackVec+i+radius, pixel);
+
+      //channel*weight fits into 16 bit
+      __m128i weight = _mm_set1_epi32(radius+1-(i < 0 ? -i : i));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(pixel, weight));
+      if(i <= 0)
+         outSum = _mm_add_epi32(outSum, pixel);
+      else
+         inSum = _mm_add_epi32(inSum, pixel);
+   }
+
+   int stackpointer = radius;
+   int xp = begin+radius;
+   if(xp > last)
+      xp = last;
+
+   for(int x=begin; x<end; x++) {
+      dst[x*dstStep] = packPixel(mulShift(sum, mul, shiftCount));
+
+      sum = _mm_sub_epi32(sum, outSum);
+
+      int stackStart = stackpointer + div - radius;
+      if(stackStart >= div)
+         stackStart -= div;
+
+      outSum = _mm_sub_epi32(outSum, _mm_loadu_si128(stackVec+stackStart));
+
+      if(xp < last)
+         xp++;
+
+      __m128i pixel = unpackPixel(src[xp*srcStep]);
+      _mm_storeu_si128(stackVec+stackStart, pixel);
+      inSum = _mm_add_epi32(inSum, pixel);
+      sum = _mm_add_epi32(sum, inSum);
+
+      stackpointer++;
+      if(stackpointer >= div)
+         stackpointer = 0;
+
+      pixel = _mm_loadu_si128(stackVec+stackpointer);
+      outSum = _mm_add_epi32(outSum, pixel);
+      inSum = _mm_sub_epi32(inSum, pixel);
+   }
+}
+#endif
+
+#ifdef IMAGEUTILS_AVX2
+//two lines at once, the lower 128 bit hold the first line, the upper ones the second
+
+IMAGEUTILS_TARGET_AVX2 static inline __m256i unpackPixels(uint32_t first, uint32_t second) {
+   __m128i bytes = _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)clearAlpha(first)),
+                                      _mm_cvtsi32_si128((int)clearAlpha(second)));
+   return _mm256_cvtepu8_epi32(bytes);
+}
+
+IMAGEUTILS_TARGET_AVX2 static void blurLinesAVX2(const uint32_t *src, ptrdiff_t srcStep, ptrdiff_t srcLineStep,
+                                                 uint32_t *dst, ptrdiff_t dstStep, ptrdiff_t dstLineStep, int length,
+                                                 int begin, int end, int radius, uint32_t multiplicator, uint32_t shift,
+                                                 uint32_t *stack) {
+   int div = radius+radius+1;
+   int last = length-1;
+   __m256i mul = _mm256_set1_epi32((int)multiplicator);
+   __m128i shiftCount = _mm_cvtsi32_si128((int)shift);
+   __m256i channelMask = _mm256_set1_epi32(0xff);
+   __m256i *stackVec = (__m256i*)stack;
+
+   __m256i sum = _mm256_setzero_si256();
+   __m256i inSum = _mm256_setzero_si256();
+   __m256i outSum = _mm256_setzero_si256();
+
+   for(int i=-radius; i<=radius; i++) {
+      int xp = begin+i;
+      if(xp < 0)
+         xp = 0;
+      if(xp > last)
+         xp = last;
+      __m256i pixel = unpackPixels(src[xp*srcStep], src[xp*srcStep+srcLineStep]);
+      _mm256_storeu_si256(stackVec+i+radius, pixel);
+
+      __m256i weight = _mm256_set1_epi32(radius+1-(i < 0 ? -i : i));
+      sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(pixel, weight));
+      if(i <= 0)
+         outSum = _mm256_add_epi32(outSum, pixel);
+      else
+         inSum = _mm256_add_epi32(inSum, pixel);
+   }
+
+   int stackpointer = radius;
+   int xp = begin+radius;
+   if(xp > last)
+      xp = last;
+
+   for(int x=begin; x<end; x++) {
+      __m256i channels = _mm256_srl_epi32(_mm256_mullo_epi32(sum, mul), shiftCount);
+      channels = _mm256_and_si256(channels, channelMask);
+      channels = _mm256_packus_epi32(channels, channels);
+      channels = _mm256_packus_epi16(channels, channels);
+      dst[x*dstStep] = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(channels));
+      dst[x*dstStep+dstLineStep] = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(channels, 1));
+
+      sum = _mm256_sub_epi32(sum, outSum);
+
+      int stackStart = stackpointer + div - radius;
+      if(stackStart >= div)
+         stackStart -= div;
+
+      outSum = _mm256_sub_epi32(outSum, _mm256_loadu_si256(stackVec+stackStart));
+
+      if(xp < last)
+         xp++;
+
+      __m256i pixel = unpackPixels(src[xp*srcStep], src[xp*srcStep+srcLineStep]);
+      _mm256_storeu_si256(stackVec+stackStart, pixel);
+      inSum = _mm256_add_epi32(inSum, pixel);
+      sum = _mm256_add_epi32(sum, inSum);
+
+      stackpointer++;
+      if(stackpointer >= div)
+         stackpointer = 0;
+
+      pixel = _mm256_loadu_si256(stackVec+stackpointer);
+      outSum = _mm256_add_epi32(outSum, pixel);
+      inSum = _mm256_sub_epi32(inSum, pixel);
+   }
+}
+#endif
+
+//=== the passes
+
+inline Instrument::Stage passStage(const Stackblur::Pass &pass) {
+   return (pass.srcStep == 1) ? Instrument::StageBlurRows : Instrument::StageBlurColumns;
+}
+
+Stackblur::Pass Stackblur::rowPass(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int radius) {
+   Pass pass;
+   pass.src = pass.dst = &pixelbuffer[x0+y0*pitch];
+   pass.srcStep = pass.dstStep = 1;
+   pass.srcLineStep = pass.dstLineStep = pitch;
+   pass.length = x1-x0;
+   pass.radius = clampRadius(radius);
+   return pass;
+}
+
+Stackblur::Pass Stackblur::columnPass(uint32_t *pixelbuffer, int pitch, int x0, int y0, int y1, int radius) {
+   Pass pass;
+   pass.src = pass.dst = &pixelbuffer[x0+y0*pitch];
+   pass.srcStep = pass.dstStep = pitch;
+   pass.srcLineStep = pass.dstLineStep = 1;
+   pass.length = y1-y0;
+   pass.radius = clampRadius(radius);
+   return pass;
+}
+
+void Stackblur::runPass(const Pass &pass, int lineBegin, int lineEnd, int begin, int end) {
+   if((pass.radius <= 0) || (lineBegin >= lineEnd) || (begin >= end))
+      return;
+   IMAGEUTILS_SCOPE(passStage(pass), (lineEnd-lineBegin)*(end-begin));
+   uint32_t *stack = new uint32_t[pass.radius+pass.radius+1];
+   for(int line=lineBegin; line<lineEnd; ++line) {
+      blurLine(pass.src+line*pass.srcLineStep, pass.srcStep, pass.dst+line*pass.dstLineStep, pass.dstStep,
+               pass.length, begin, end, pass.radius, mMulTable[pass.radius], mShiftTable[pass.radius], stack);
+   }
+   delete[] stack;
+}
+
+#ifdef IMAGEUTILS_SSE2
+void Stackblur::runPassSSE2(const Pass &pass, int lineBegin, int lineEnd, int begin, int end) {
+   if((pass.radius <= 0) || (lineBegin >= lineEnd) || (begin >= end))
+      return;
+   IMAGEUTILS_SCOPE(passStage(pass), (lineEnd-lineBegin)*(end-begin));
+   uint32_t *stack = new uint32_t[(pass.radius+pass.radius+1)*4];
+   for(int line=lineBegin; line<lineEnd; ++line) {
+      blurLineSSE2(pass.src+line*pass.srcLineStep, pass.srcStep, pass.dst+line*pass.dstLineStep, pass.dstStep,
+                   pass.length, begin, end, pass.radius, mMulTable[pass.radius], mShiftTable[pass.radius], stack);
+   }
+   delete[] stack;
+}
+#endif
+
+#ifdef IMAGEUTILS_AVX2
+void Stackblur::runPassAVX2(const Pass &pass, int lineBegin, int lineEnd, int begin, int end) {
+   if((pass.radius <= 0) || (lineBegin >= lineEnd) || (begin >= end))
+      return;
+   int line = lineBegin;
+   {
+      IMAGEUTILS_SCOPE(passStage(pass), ((lineEnd-lineBegin) & ~1)*(end-begin));
+      uint32_t *stack = new uint32_t[(pass.radius+pass.radius+1)*8];
+      for(; line+1<lineEnd; line+=2) {
+         blurLinesAVX2(pass.src+line*pass.srcLineStep, pass.srcStep, pass.srcLineStep,
+                       pass.dst+line*pass.dstLineStep, pass.dstStep, pass.dstLineStep,
+                       pass.length, begin, end, pass.radius, mMulTable[pass.radius], mShiftTable[pass.radius], stack);
+      }
+      delete[] stack;
+   }
+   //odd line count, the last one goes through the sse2 kernel
+   if(line < lineEnd)
+      runPassSSE2(pass, line, lineEnd, begin, end);
+}
+#endif
+
+//=== blurring a rectangle
+
+void Stackblur::blur(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY) {
+   int width = x1-x0;
+   int height = y1-y0;
+   runPass(rowPass(pixelbuffer, pitch, x0, y0, x1, radiusX), 0, height, 0, width);
+   runPass(columnPass(pixelbuffer, pitch, x0, y0, y1, radiusY), 0, width, 0, height);
+}
+
+#ifdef IMAGEUTILS_SSE2
+void Stackblur::blurSSE2(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY) {
+   int width = x1-x0;
+   int height = y1-y0;
+   runPassSSE2(rowPass(pixelbuffer, pitch, x0, y0, x1, radiusX), 0, height, 0, width);
+   runPassSSE2(columnPass(pixelbuffer, pitch, x0, y0, y1, radiusY), 0, width, 0, height);
+}
+#endif
+
+#ifdef IMAGEUTILS_AVX2
+void Stackblur::blurAVX2(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY) {
+   int width = x1-x0;
+   int height = y1-y0;
+   runPassAVX2(rowPass(pixelbuffer, pitch, x0, y0, x1, radiusX), 0, height, 0, width);
+   runPassAVX2(columnPass(pixelbuffer, pitch, x0, y0, y1, radiusY), 0, width, 0, height);
+}
+#endif
+
+void Stackblur::blurFast(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY) {
+   int width = x1-x0;
+   int height = y1-y0;
+   const Kernels &kernels = getKernels();
+   kernels.runPass(rowPass(pixelbuffer, pitch, x0, y0, x1, radiusX), 0, height, 0, width);
+   kernels.runPass(columnPass(pixelbuffer, pitch, x0, y0, y1, radiusY), 0, width, 0, height);
+}
+
+const Stackblur::Kernels &Stackblur::getKernels(CpuLevel level) {
+   static const Kernels scalar = { runPass };
+#ifdef IMAGEUTILS_SSE2
+   static const Kernels sse2 = { runPassSSE2 };
+   if(level == CpuLevelSSE2)
+      return sse2;
+#endif
+#ifdef IMAGEUTILS_AVX2
+   static const Kernels avx2 = { runPassAVX2 };
+   if(level >= CpuLevelAVX2)
+      return avx2;
+#endif
+   return scalar;
+}
+
+void Stackblur::runPassDefault(const Pass &pass, int lineBegin, int lineEnd, int begin, int end) {
+   getKernels().runPass(pass, lineBegin, lineEnd, begin, end);
+}
+
+void Stackblur::blurParallel(Executor &executor, uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1,
+                             int radiusX, int radiusY) {
+   int width = x1-x0;
+   int height = y1-y0;
+   if((width <= 0) || (height <= 0))
+      return;
+
+   if(radiusX > 0) {
+      Pass rows = rowPass(pixelbuffer, pitch, x0, y0, x1, radiusX);
+      int parts = executor.getNumberJobs(height, MinimumRows);
+      executor.run(parts, [&](int part) {
+         runPassDefault(rows, Executor::partBegin(0, height, parts, part),
+                        Executor::partBegin(0, height, parts, part+1), 0, width);
+      });
+   }
+
+   //run() only returns when all rows are done, so the column pass sees the finished rows
+   if(radiusY > 0) {
+      Pass columns = columnPass(pixelbuffer, pitch, x0, y0, y1, radiusY);
+      int blocks = (width+ColumnBlock-1) / ColumnBlock;
+      int parts = executor.getNumberJobs(blocks, 1);
+      executor.run(parts, [&](int part) {
+         int begin = Executor::partBegin(0, blocks, parts, part) * ColumnBlock;
+         int end = eastl::min(Executor::partBegin(0, blocks, parts, part+1) * ColumnBlock, width);
+         runPassDefault(columns, begin, end, 0, height);
+      });
+   }
+}
+
+//=== blurring with big radii
+
+int Stackblur::pyramidLevels(int size, int radius) {
+   int levels = 0;
+   while(((radius >> levels) > PyramidRadius) && ((size >> levels) > 1))
+      levels++;
+   return levels;
+}
+
+int Stackblur::pyramidLevels(int width, int height, int radiusX, int radiusY) {
+   return eastl::max(pyramidLevels(width, radiusX), pyramidLevels(height, radiusY));
+}
+
+void Stackblur::blurLarge(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY) {
+   int width = x1-x0;
+   int height = y1-y0;
+   if((width <= 0) || (height <= 0))
+      return;
+   int levelsX = pyramidLevels(width, radiusX);
+   int levelsY = pyramidLevels(height, radiusY);
+   if((levelsX == 0) && (levelsY == 0)) {
+      blurFast(pixelbuffer, pitch, x0, y0, x1, y1, radiusX, radiusY);
+      return;
+   }
+   ImageView source(&pixelbuffer[x0+y0*pitch], width, height, pitch*sizeof(uint32_t));
+
+   //the halvings both axes need with 2x2 averages, both buffers fit into the size of the first level
+   int levels = eastl::min(levelsX, levelsY);
+   int levelWidth = width;
+   int levelHeight = height;
+   uint32_t *level = nullptr;
+   if(levels > 0) {
+      levelWidth = (width+1)/2;
+      levelHeight = (height+1)/2;
+      level = new uint32_t[levelWidth*levelHeight];
+      uint32_t *temp = new uint32_t[levelWidth*levelHeight];
+      ImageResize::halve(source, ImageView::fromPixels(level, levelWidth, levelHeight));
+      for(int i=1; i<levels; ++i) {
+         ImageResize::halve(ImageView::fromPixels(level, levelWidth, levelHeight),
+                            ImageView::fromPixels(temp, (levelWidth+1)/2, (levelHeight+1)/2));
+         uint32_t *swap = level;
+         level = temp;
+         temp = swap;
+         levelWidth = (levelWidth+1)/2;
+         levelHeight = (levelHeight+1)/2;
+      }
+      delete[] temp;
+   }
+
+   //the rest of the longer axis with a box filter, the other axis keeps its size
+   if(levelsX != levelsY) {
+      int smallWidth = levelWidth;
+      int smallHeight = levelHeight;
+      for(int i=levels; i<levelsX; ++i)
+         smallWidth = (smallWidth+1)/2;
+      for(int i=levels; i<levelsY; ++i)
+         smallHeight = (smallHeight+1)/2;
+      uint32_t *small = new uint32_t[smallWidth*smallHeight];
+      ImageResize::resample<BoxFilter>(level ? ImageView::fromPixels(level, levelWidth, levelHeight) : source,
+                                       ImageView::fromPixels(small, smallWidth, smallHeight));
+      delete[] level;
+      level = small;
+      levelWidth = smallWidth;
+      levelHeight = smallHeight;
+   }
+
+   //an axis that wasn't halved is blurred with its own radius
+   blurFast(level, levelWidth, 0, 0, levelWidth, levelHeight, (radiusX + (1 << levelsX)/2) >> levelsX,
+            (radiusY + (1 << levelsY)/2) >> levelsY);
+
+   ImageResize::resample<TriangleFilter>(ImageView::fromPixels(level, levelWidth, levelHeight), source);
+   delete[] level;
+}
+
+//=== the cache for incremental blurs
+
+StackblurCache::StackblurCache()
+   : mSource(nullptr), mSourcePitch(0), mWidth(0), mHeight(0), mRadiusX(0), mRadiusY(0),
+     mHorizontal(nullptr), mResult(nullptr), mNumberDirty(0) {
+}
+
+StackblurCache::~StackblurCache() {
+   delete[] mHorizontal;
+   delete[] mResult;
+}
+
+void StackblurCache::setSource(const uint32_t *source, int pitch, int width, int height, int radiusX, int radiusY) {
+   if((width != mWidth) || (height != mHeight)) {
+      delete[] mHorizontal;
+      delete[] mResult;
+      mHorizontal = new uint32_t[width*height];
+      mResult = new uint32_t[width*height];
+   }
+   mSource = source;
+   mSourcePitch = pitch;
+   mWidth = width;
+   mHeight = height;
+   mRadiusX = Stackblur::clampRadius(radiusX);
+   mRadiusY = Stackblur::clampRadius(radiusY);
+   mNumberDirty = 0;
+
+   horizontalPass(0, 0, width, height);
+   verticalPass(0, 0, width, height);
+}
+
+void StackblurCache::invalidate(int x0, int y0, int x1, int y1) {
+   x0 = eastl::max(x0, 0);
+   y0 = eastl::max(y0, 0);
+   x1 = eastl::min(x1, mWidth);
+   y1 = eastl::min(y1, mHeight);
+   if((x0 >= x1) || (y0 >= y1))
+      return;
+
+   if(mNumberDirty == MaxDirtyRects) {
+      Rect &bounds = mDirty[0];
+      for(int i=1; i<mNumberDirty; ++i) {
+         bounds.x0 = eastl::min(bounds.x0, mDirty[i].x0);
+         bounds.y0 = eastl::min(bounds.y0, mDirty[i].y0);
+         bounds.x1 = eastl::max(bounds.x1, mDirty[i].x1);
+         bounds.y1 = eastl::max(bounds.y1, mDirty[i].y1);
+      }
+      mNumberDirty = 1;
+   }
+   Rect &rect = mDirty[mNumberDirty++];
+   rect.x0 = x0;
+   rect.y0 = y0;
+   rect.x1 = x1;
+   rect.y1 = y1;
+}
+
+void StackblurCache::update() {
+   //a changed source pixel changes the row pass up to radiusX pixels left and right of it, and
+   //that changes the column pass up to radiusY pixels above and below. all row passes have to be
+   //finished before the first column pass, the rectangles may overlap
+   for(int i=0; i<mNumberDirty; ++i) {
+      const Rect &rect = mDirty[i];
+      horizontalPass(eastl::max(rect.x0-mRadiusX, 0), rect.y0, eastl::min(rect.x1+mRadiusX, mWidth), rect.y1);
+   }
+   for(int i=0; i<mNumberDirty; ++i) {
+      const Rect &rect = mDirty[i];
+      verticalPass(eastl::max(rect.x0-mRadiusX, 0), eastl::max(rect.y0-mRadiusY, 0),
+                   eastl::min(rect.x1+mRadiusX, mWidth), eastl::min(rect.y1+mRadiusY, mHeight));
+   }
+   mNumberDirty = 0;
+}
+
+void StackblurCache::horizontalPass(int x0, int y0, int x1, int y1) {
+   if(mRadiusX <= 0) {
+      for(int y=y0; y<y1; ++y)
+         memcpy(&mHorizontal[x0+y*mWidth], &mSource[x0+y*mSourcePitch], (x1-x0)*sizeof(uint32_t));
+      return;
+   }
+   Stackblur::Pass pass;
+   pass.src = mSource;
+   pass.dst = mHorizontal;
+   pass.srcStep = pass.dstStep = 1;
+   pass.srcLineStep = mSourcePitch;
+   pass.dstLineStep = mWidth;
+   pass.length = mWidth;
+   pass.radius = mRadiusX;
+   Stackblur::runPassDefault(pass, y0, y1, x0, x1);
+}
+
+void StackblurCache::verticalPass(int x0, int y0, int x1, int y1) {
+   if(mRadiusY <= 0) {
+      for(int y=y0; y<y1; ++y)
+         memcpy(&mResult[x0+y*mWidth], &mHorizontal[x0+y*mWidth], (x1-x0)*sizeof(uint32_t));
+      return;
+   }
+   Stackblur::Pass pass;
+   pass.src = mHorizontal;
+   pass.dst = mResult;
+   pass.srcStep = pass.dstStep = mWidth;
+   pass.srcLineStep = pass.dstLineStep = 1;
+   pass.length = mHeight;
+   pass.radius = mRadiusY;
+   Stackblur::runPassDefault(pass, x0, x1, y0, y1);
+}
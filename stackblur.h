@@ -3,6 +3,11 @@
 #define __IMAGEUTILS_STACKBLUR_H__
 
 #include "eastl/types.h"
+#include "simd.h"
+#include "image.h"
+#include "cpufeatures.h"
+
+class Executor;
 
 class Stackblur {
    // Stack Blur Algorithm by Mario Klingemann <mario@quasimondo.com>
@@ -25,263 +30,155 @@ class Stackblur {
     static uint8_t const mShiftTable[255];
 
 public:
-/*  static void blur(GuiPaintInfo &drawInfo, int x0, int y0, int x1, int y1, int radiusX, int radiusY) {
-
-      if(radiusX > 0) {
-         if(radiusX > 254)
-            radiusX = 254;
-         int div = radiusX+radiusX+1;
-         uint_t multiplicator = mMulTable[radiusX];
-         uint_t shift = mShiftTable[radiusX];
-
-         int width = x1-x0;
-         int height = y1-y0;
-
-         uint8_t *stack = new uint8_t[div*3];
-         for(int y=0; y<height; y++) {
-            int redSum = 0, greenSum = 0, blueSum = 0;
-            int redInSum = 0, greenInSum = 0, blueInSum = 0;
-            int redOutSum = 0, greenOutSum = 0, blueOutSum = 0;
-            
-            uint32_t *srcPointer = &drawInfo.pixelbuffer[x0+(y0+y)*drawInfo.pitch];
-            uint32_t pixel = *srcPointer;
-            uint8_t red = (pixel & 0x00ff0000) >> 16;
-            uint8_t green = (pixel & 0x0000ff00) >> 8;
-            uint8_t blue = pixel & 0x000000ff;
-            for(int i=0; i<=radiusX; i++) {
-               stack[i*3+0] = red;
-               stack[i*3+1] = green;
-               stack[i*3+2] = blue;
-
-               redSum += red * (i+1);
-               greenSum += green * (i+1);
-               blueSum += blue * (i+1);
-
-               redOutSum += red;
-               greenOutSum += green;
-               blueOutSum += blue;
-            }
-
-            for(int i=1; i<=radiusX; i++) {
-               if(i <= width-1)
-                  srcPointer += drawInfo.pitch;
-               
-               uint32_t pixel = *srcPointer;
-               uint8_t red   = (pixel & 0x00ff0000) >> 16;
-               uint8_t green = (pixel & 0x0000ff00) >> 8;
-               uint8_t blue  = pixel & 0x000000ff;
-
-               stack[(i+radiusX)*3+0] = red;
-               stack[(i+radiusX)*3+1] = green;
-               stack[(i+radiusX)*3+2] = blue;
-
-               redSum   += red*(radiusX+1-i);
-               greenSum += green*(radiusX+1-i);
-               blueSum  += blue*(radiusX+1-i);
-
-               redInSum   += red;
-               greenInSum += green;
-               blueInSum  += blue;
-            }
-
-            int stackpointer = radiusX;
-            int xp = radiusX;
-            if(xp > width-1)
-               xp = width-1;
-
-            srcPointer = &drawInfo.pixelbuffer[xp+x0+(y0+y)*drawInfo.pitch];
-            uint32_t *dstPointer = &drawInfo.pixelbuffer[x0+(y0+y)*drawInfo.pitch];
-            for(int x=0; x<width; x++) {
-               uint8_t red, green, blue;
-               red   = (redSum   * multiplicator) >> shift;
-               green = (greenSum * multiplicator) >> shift;
-               blue  = (blueSum  * multiplicator) >> shift;
-               *(dstPointer++) = (red<<16) + (green<<8) + blue;
-
-               redSum -= redOutSum;
-               greenSum -= greenOutSum;
-               blueSum -= blueOutSum;
-
-               int stackStart = stackpointer + div - radiusX;
-               if(stackStart >= div)
-                  stackStart -= div;
-
-               stackStart *= 3;
-              
-               redOutSum -= stack[stackStart+0];
-               greenOutSum -= stack[stackStart+1];
-               blueOutSum -= stack[stackStart+2];
-
-               if(xp < width-1) {
-                  srcPointer++;
-                  xp++;
-               }
-
-               pixel = *srcPointer;
-               red   = (pixel & 0x00ff0000) >> 16;
-               green = (pixel & 0x0000ff00) >> 8;
-               blue  = pixel & 0x000000ff;
-
-               stack[stackStart+0] = red;
-               stack[stackStart+1] = green;
-               stack[stackStart+2] = blue;
-
-               redInSum += red;
-               greenInSum += green;
-               blueInSum += blue;
-
-               redSum += redInSum;
-               greenSum += greenInSum;
-               blueSum += blueInSum;
-
-               stackpointer++;
-               if(stackpointer >= div)
-                  stackpointer = 0;
-
-               red = stack[stackpointer*3+0];
-               green = stack[stackpointer*3+1];
-               blue = stack[stackpointer*3+2];
-
-               redOutSum += red;
-               greenOutSum += green;
-               blueOutSum += blue;
-               
-               redInSum -= red;
-               greenInSum -= green;
-               blueInSum -= blue;
-            }
-         }
-         delete[] stack;
-      }
-      
-      if(radiusY > 0) {
-         if(radiusY > 254)
-            radiusY = 254;
-         int div = radiusY + radiusY +1;
-         uint_t multiplicator = mMulTable[radiusY];
-         uint_t shift = mShiftTable[radiusY];
-
-         int width = x1-x0;
-         int height = y1-y0;
-
-         uint8_t *stack = new uint8_t[div*3];
-
-         for(int x=0; x<width; x++) {
-            int redSum = 0, greenSum = 0, blueSum = 0;
-            int redInSum = 0, greenInSum = 0, blueInSum = 0;
-            int redOutSum = 0, greenOutSum = 0, blueOutSum = 0;
-
-            uint32_t *srcPointer = &drawInfo.pixelbuffer[x0+x+y0*drawInfo.pitch];
-            uint32_t pixel = *srcPointer;
-            uint8_t red = (pixel & 0x00ff0000) >> 16;
-            uint8_t green = (pixel & 0x0000ff00) >> 8;
-            uint8_t blue = pixel & 0x000000ff;
-            for(int i=0; i<=radiusY; i++) {
-               stack[i*3+0] = red;
-               stack[i*3+1] = green;
-               stack[i*3+2] = blue;
-
-               redSum += red * (i+1);
-               greenSum += green * (i+1);
-               blueSum += blue * (i+1);
-
-               redOutSum += red;
-               greenOutSum += green;
-               blueOutSum += blue;
-            }
-            for(int i=1; i<=radiusY; i++) {
-               if(i<=height-1)
-                  srcPointer += drawInfo.pitch;
-                  pixel = *srcPointer;
-                  red = (pixel & 0x00ff0000) >> 16;
-                  green = (pixel & 0x0000ff00) >> 8;
-                  blue = pixel & 0x000000ff;
-                  
-                  stack[(i+radiusY)*3+0] = red;
-                  stack[(i+radiusY)*3+1] = green;
-                  stack[(i+radiusY)*3+2] = blue;
-
-                  redSum += red * (radiusY+1-i);
-                  greenSum += green * (radiusY+1-i);
-                  blueSum += blue * (radiusY+1-i);
-
-                  redInSum += red;
-                  greenInSum += green;
-                  blueInSum += blue;
-            }
-            int stackpointer = radiusY;
-            int yp = radiusY;
-            if(yp > height-1)
-               yp = height-1;
-            srcPointer = &drawInfo.pixelbuffer[x0+x+(y0+yp)*drawInfo.pitch];
-            uint32_t *dstPointer = &drawInfo.pixelbuffer[x0+x+y0*drawInfo.pitch];
-            for(int y=0; y<height; y++) {
-               red = (redSum*multiplicator) >> shift;
-               green = (greenSum*multiplicator) >> shift;
-               blue = (blueSum*multiplicator) >> shift;
-               *dstPointer = (red<<16) + (green<<8) + blue;
-               dstPointer += drawInfo.pitch;
-
-               redSum -= redOutSum;
-               greenSum -= greenOutSum;
-               blueSum -= blueOutSum;
-
-               int stackStart = stackpointer + div - radiusY;
-               if(stackStart >= div)
-                  stackStart -= div;
-
-               stackStart *= 3;
-
-               red = stack[stackStart+0];
-               green = stack[stackStart+1];
-               blue = stack[stackStart+2];
-
-               redOutSum -= red;
-               greenOutSum -= green;
-               blueOutSum -= blue;
-
-               if(yp < height-1) {
-                  srcPointer += drawInfo.pitch;
-                  yp++;
-               }
-
-               pixel = *srcPointer;
-               red   = (pixel & 0x00ff0000) >> 16;
-               green = (pixel & 0x0000ff00) >> 8;
-               blue  = pixel & 0x000000ff;
-
-               stack[stackStart+0] = red;
-               stack[stackStart+1] = green;
-               stack[stackStart+2] = blue;
-
-               redInSum += red;
-               greenInSum += green;
-               blueInSum += blue;
-
-               redSum += redInSum;
-               greenSum += greenInSum;
-               blueSum += blueInSum;
-
-               stackpointer++;
-               if(stackpointer >= div)
-                  stackpointer = 0;
-
-               red = stack[stackpointer*3+0];
-               green = stack[stackpointer*3+1];
-               blue = stack[stackpointer*3+2];
-
-               redOutSum += red;
-               greenOutSum += green;
-               blueOutSum += blue;
+   //one direction of the blur: a set of lines, each blurred independently. the horizontal
+   //pass walks the rows of the rectangle, the vertical pass walks its columns
+   struct Pass {
+      const uint32_t *src;
+      uint32_t *dst;                         //may be the same as src
+      ptrdiff_t srcStep, dstStep;            //distance between two pixels of a line
+      ptrdiff_t srcLineStep, dstLineStep;    //distance between two lines
+      int length;                            //pixels per line
+      int radius;
+   };
+
+   static Pass rowPass(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int radius);
+   static Pass columnPass(uint32_t *pixelbuffer, int pitch, int x0, int y0, int y1, int radius);
+
+   //blur the pixels [begin, end) of the lines [lineBegin, lineEnd) of a pass. the pixels outside of
+   //[begin, end) are still read as far as the radius reaches, the edges of a line are repeated
+   static void runPass(const Pass &pass, int lineBegin, int lineEnd, int begin, int end);
+#ifdef IMAGEUTILS_SSE2
+   static void runPassSSE2(const Pass &pass, int lineBegin, int lineEnd, int begin, int end);
+#endif
+#ifdef IMAGEUTILS_AVX2
+   static void runPassAVX2(const Pass &pass, int lineBegin, int lineEnd, int begin, int end);
+#endif
+
+   //blurs the rectangle [x0, x1) x [y0, y1) of the pixelbuffer in place, pitch is in pixels.
+   //only the color channels are blurred, alpha is cleared. radii are clamped to 254
+   static void blur(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY);
+#ifdef IMAGEUTILS_SSE2
+   //the vector versions give the same result as blur() down to the bit
+   static void blurSSE2(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY);
+#endif
+#ifdef IMAGEUTILS_AVX2
+   static void blurAVX2(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY);
+#endif
+   //blur() with the fastest kernel of the cpu level in use, see CpuFeatures. blur() itself always
+   //stays the scalar reference
+   static void blurFast(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY);
+
+   //the pass kernels of one cpu level
+   struct Kernels {
+      void (*runPass)(const Pass &pass, int lineBegin, int lineEnd, int begin, int end);
+   };
+   static const Kernels &getKernels(CpuLevel level);
+   static const Kernels &getKernels() { return getKernels(CpuFeatures::getLevel()); }
+
+   //same result as blur(), but bands of rows and afterwards blocks of columns are run as jobs of
+   //the executor (a ThreadPool for example). still works in place on the caller's pixelbuffer
+   static void blurParallel(Executor &executor, uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1,
+                            int radiusX, int radiusY);
+
+   //for radii far beyond MaxRadius: each axis of the rectangle is halved in size until its radius
+   //is at most PyramidRadius, the picture is blurred there with the scaled radii and resized back
+   //with a triangle filter. costs about the same for every radius, but is an approximation of a
+   //real blur with that radius. an axis with a radius of at most PyramidRadius keeps its size and
+   //gets an exact blur, blurLarge(r, 0) doesn't blur vertically at all
+   static void blurLarge(uint32_t *pixelbuffer, int pitch, int x0, int y0, int x1, int y1, int radiusX, int radiusY);
+   //number of halvings blurLarge() does on an axis of a size with a radius
+   static int pyramidLevels(int size, int radius);
+   //the most halvings of both axes, 0 when blurLarge() is the same as blurFast()
+   static int pyramidLevels(int width, int height, int radiusX, int radiusY);
+
+   //the same on a 32 bit view, which may be a crop of a bigger picture
+   static void blur(const ImageView &view, int radiusX, int radiusY) {
+      if(view.is32Bit())
+         blur((uint32_t*)view.data, view.pitch(), 0, 0, view.width, view.height, radiusX, radiusY);
+   }
+   static void blurFast(const ImageView &view, int radiusX, int radiusY) {
+      if(view.is32Bit())
+         blurFast((uint32_t*)view.data, view.pitch(), 0, 0, view.width, view.height, radiusX, radiusY);
+   }
+   static void blurParallel(Executor &executor, const ImageView &view, int radiusX, int radiusY) {
+      if(view.is32Bit())
+         blurParallel(executor, (uint32_t*)view.data, view.pitch(), 0, 0, view.width, view.height, radiusX, radiusY);
+   }
+   static void blurLarge(const ImageView &view, int radiusX, int radiusY) {
+      if(view.is32Bit())
+         blurLarge((uint32_t*)view.data, view.pitch(), 0, 0, view.width, view.height, radiusX, radiusY);
+   }
+
+   static int clampRadius(int radius) {
+      return radius > MaxRadius ? MaxRadius : radius;
+   }
+
+   enum { MaxRadius = 254 };
+   //columns are handed out in blocks of a cache line so two threads never write the same line
+   enum { ColumnBlock = 16 };
+   //rows of the smallest band a row pass is split into
+   enum { MinimumRows = 8 };
+   enum { PyramidRadius = 16 };
+
+private:
+   friend class StackblurCache;
+
+   //the kernel of the cpu level in use
+   static void runPassDefault(const Pass &pass, int lineBegin, int lineEnd, int begin, int end);
+};
 
-               redInSum -= red;
-               greenInSum -= green;
-               blueInSum -= blue;
-            }
-         }
-         delete[] stack;
-      }
-   }*/
+//keeps the blurred version of a picture up to date while only small parts of it change. the
+//source stays owned by the caller; after changing it the changed rectangles are passed to
+//invalidate() and update() recalculates only the pixels that depend on them, in both passes
+//the dirty rectangle grows by the radius. the result is the same as blurring the whole picture
+class StackblurCache {
+public:
+   StackblurCache();
+   ~StackblurCache();
+
+   //blurs the whole source, pitch is in pixels. the source must stay valid as long as it is
+   //used by update()
+   void setSource(const uint32_t *source, int pitch, int width, int height, int radiusX, int radiusY);
+   //a view of other than 32 bit pixels gives an empty source
+   void setSource(const ImageView &source, int radiusX, int radiusY) {
+      if(source.is32Bit())
+         setSource((const uint32_t*)source.data, source.pitch(), source.width, source.height, radiusX, radiusY);
+      else
+         setSource(nullptr, 0, 0, 0, radiusX, radiusY);
+   }
+
+   //marks [x0, x1) x [y0, y1) of the source as changed
+   void invalidate(int x0, int y0, int x1, int y1);
+   //recalculates everything that depends on the invalidated rectangles
+   void update();
+
+   const uint32_t *getResult() const { return mResult; }
+   ImageView getResultView() const { return ImageView::fromPixels(mResult, mWidth, mHeight); }
+   int getWidth() const { return mWidth; }
+   int getHeight() const { return mHeight; }
+
+   //too many rectangles are merged into one bounding rectangle
+   enum { MaxDirtyRects = 16 };
+
+private:
+   StackblurCache(const StackblurCache &);
+   StackblurCache &operator=(const StackblurCache &);
+
+   struct Rect {
+      int x0, y0, x1, y1;
+   };
+
+   void horizontalPass(int x0, int y0, int x1, int y1);
+   void verticalPass(int x0, int y0, int x1, int y1);
+
+   const uint32_t *mSource;
+   int mSourcePitch;
+   int mWidth, mHeight;
+   int mRadiusX, mRadiusY;
+   uint32_t *mHorizontal;     //result of the row pass, mWidth pixels per line
+   uint32_t *mResult;         //result of the column pass, mWidth pixels per line
+   Rect mDirty[MaxDirtyRects];
+   int mNumberDirty;
 };
 
 #endif   //#ifndef __IMAGEUTILS_STACKBLUR_H__
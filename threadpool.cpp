@@ -0,0 +1,145 @@
+
+#include "threadpool.h"
+
+//the pool and queue of a worker thread, nullptr for every other thread
+static thread_local ThreadPool *tPool = nullptr;
+static thread_local int tQueue = 0;
+
+ThreadPool::ThreadPool(int numberThreads)
+   : mQueued(0), mSleeping(0), mQuit(false) {
+   if(numberThreads <= 0)
+      numberThreads = (int)std::thread::hardware_concurrency();
+   if(numberThreads <= 0)
+      numberThreads = 1;
+   for(int i=0; i<numberThreads; ++i)
+      mQueues.push_back(new Queue);
+   for(int i=1; i<numberThreads; ++i)
+      mWorkers.push_back(std::thread(&ThreadPool::workerLoop, this, i-1));
+}
+
+ThreadPool::~ThreadPool() {
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+   }
+   mWakeup.notify_all();
+   for(size_t i=0; i<mWorkers.size(); ++i)
+      mWorkers[i].join();
+   for(size_t i=0; i<mQueues.size(); ++i)
+      delete mQueues[i];
+}
+
+ThreadPool &ThreadPool::getShared() {
+   static ThreadPool pool;
+   return pool;
+}
+
+int ThreadPool::getQueue() const {
+   return (tPool == this) ? tQueue : (int)mWorkers.size();
+}
+
+void ThreadPool::run(int numberJobs, const std::function<void(int job)> &job) {
+   if(numberJobs <= 0)
+      return;
+   if(mWorkers.empty() || (numberJobs == 1)) {
+      for(int i=0; i<numberJobs; ++i)
+         job(i);
+      return;
+   }
+
+   Group group;
+   group.job = &job;
+   group.pending = numberJobs;
+   int queue = getQueue();
+   Task all = { &group, 0, numberJobs };
+   push(queue, all);
+
+   while(group.pending > 0) {
+      Task task;
+      if(findTask(queue, task)) {
+         execute(queue, task);
+         continue;
+      }
+      //everything left of the group is running on other threads
+      std::unique_lock<std::mutex> lock(mMutex);
+      mSleeping++;
+      mWakeup.wait(lock, [&] { return (group.pending == 0) || (mQueued > 0); });
+      mSleeping--;
+   }
+}
+
+void ThreadPool::push(int queue, const Task &task) {
+   //counted first, so mQueued is never below the real number of tasks
+   mQueued++;
+   {
+      std::lock_guard<std::mutex> lock(mQueues[queue]->mutex);
+      mQueues[queue]->tasks.push_back(task);
+   }
+   //a thread that went to sleep before the increment is woken here, one after it sees mQueued
+   if(mSleeping > 0) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mWakeup.notify_one();
+   }
+}
+
+bool ThreadPool::findTask(int queue, Task &task) {
+   if(mQueued == 0)
+      return false;
+   //the own queue from the back, the newest and smallest range next to the one just done
+   {
+      Queue &own = *mQueues[queue];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if(!own.tasks.empty()) {
+         task = own.tasks.back();
+         own.tasks.pop_back();
+         mQueued--;
+         return true;
+      }
+   }
+   //the other queues from the front, the oldest and biggest ranges
+   int numberQueues = (int)mQueues.size();
+   for(int i=1; i<numberQueues; ++i) {
+      Queue &other = *mQueues[(queue+i) % numberQueues];
+      std::lock_guard<std::mutex> lock(other.mutex);
+      if(!other.tasks.empty()) {
+         task = other.tasks.front();
+         other.tasks.pop_front();
+         mQueued--;
+         return true;
+      }
+   }
+   return false;
+}
+
+void ThreadPool::execute(int queue, Task task) {
+   //keep the first job, the upper halves are left for this and other threads
+   while(task.end-task.begin > 1) {
+      Task upper = { task.group, task.begin + (task.end-task.begin)/2, task.end };
+      push(queue, upper);
+      task.end = upper.begin;
+   }
+   (*task.group->job)(task.begin);
+   //the group lives on the stack of its run() and is gone as soon as pending reaches 0
+   if(--task.group->pending == 0) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mWakeup.notify_all();
+   }
+}
+
+void ThreadPool::workerLoop(int queue) {
+   tPool = this;
+   tQueue = queue;
+   for(;;) {
+      Task task;
+      if(findTask(queue, task)) {
+         execute(queue, task);
+         continue;
+      }
+      std::unique_lock<std::mutex> lock(mMutex);
+      mSleeping++;
+      mWakeup.wait(lock, [this] { return mQuit || (mQueued > 0); });
+      mSleeping--;
+      if(mQuit)
+         return;
+   }
+}
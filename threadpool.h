@@ -0,0 +1,112 @@
+
+#ifndef __IMAGEUTILS_THREADPOOL_H__
+#define __IMAGEUTILS_THREADPOOL_H__
+
+#include "eastl/types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//what the parallel entry points of ImageResize, Stackblur and Blitter hand their row and tile jobs
+//to. ThreadPool is the built in one, an application with its own scheduler derives from Executor
+//and forwards run() to it
+class Executor {
+public:
+   virtual ~Executor() {}
+
+   //number of threads that may work on one run() at the same time
+   virtual int getNumberThreads() const = 0;
+
+   //calls job(0) .. job(numberJobs-1) in any order and on any thread and returns when all of them
+   //have finished, so two calls in a row act as a barrier. a job may call run() again
+   virtual void run(int numberJobs, const std::function<void(int job)> &job) = 0;
+
+   //how many jobs size items are split into: a few per thread so that stealing evens out uneven
+   //jobs, but at least minimumSize items per job. one job when there is only one thread
+   int getNumberJobs(int size, int minimumSize) const {
+      if(size <= 0)
+         return 0;
+      int jobs = (getNumberThreads() > 1) ? eastl::min(getNumberThreads()*JobsPerThread, size/minimumSize) : 1;
+      return eastl::max(jobs, 1);
+   }
+
+   //the range [begin, end) split into numberParts pieces of (nearly) the same size, the split
+   //only depends on the arguments so the same call always produces the same partitioning
+   static int partBegin(int begin, int end, int numberParts, int part) {
+      return begin + (int)(((int64_t)(end-begin)*part) / numberParts);
+   }
+
+   enum { JobsPerThread = 4 };
+};
+
+//runs every job on the calling thread, in order
+class SerialExecutor : public Executor {
+public:
+   int getNumberThreads() const { return 1; }
+   void run(int numberJobs, const std::function<void(int job)> &job) {
+      for(int i=0; i<numberJobs; ++i)
+         job(i);
+   }
+};
+
+//a fixed set of worker threads with one job queue each. run() puts the whole range of jobs into
+//the queue of the calling thread, whoever executes a range leaves its upper half in its own queue
+//and idle threads steal from the other queues. the caller works on jobs until its run() is done,
+//also on jobs of other run()s, so a run() from inside a job neither blocks a thread nor starts
+//new ones: parallel over pictures with every picture parallel over bands just works
+class ThreadPool : public Executor {
+public:
+   //0 threads uses one thread per hardware core
+   explicit ThreadPool(int numberThreads = 0);
+   ~ThreadPool();
+
+   //number of threads working on a run(), including the caller
+   int getNumberThreads() const { return (int)mWorkers.size()+1; }
+
+   void run(int numberJobs, const std::function<void(int job)> &job);
+
+   //one pool for the whole process with a thread per core, for everybody who doesn't want to
+   //manage one. created on first use
+   static ThreadPool &getShared();
+
+private:
+   ThreadPool(const ThreadPool &);
+   ThreadPool &operator=(const ThreadPool &);
+
+   //the jobs of one run()
+   struct Group {
+      const std::function<void(int)> *job;
+      std::atomic<int> pending;
+   };
+   //the jobs [begin, end) of a group
+   struct Task {
+      Group *group;
+      int begin, end;
+   };
+   struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+   };
+
+   void workerLoop(int queue);
+   void push(int queue, const Task &task);
+   bool findTask(int queue, Task &task);
+   void execute(int queue, Task task);
+   //the queue of the calling thread, threads outside of the pool share the last one
+   int getQueue() const;
+
+   std::vector<std::thread> mWorkers;
+   std::vector<Queue*> mQueues;
+   std::mutex mMutex;
+   std::condition_variable mWakeup;
+   std::atomic<int> mQueued;        //tasks in all queues
+   std::atomic<int> mSleeping;      //threads waiting on mWakeup
+   bool mQuit;
+};
+
+#endif   //#ifndef __IMAGEUTILS_THREADPOOL_H__
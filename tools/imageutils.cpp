@@ -0,0 +1,424 @@
+
+//batch resize, blur and format conversion of ppm, pam and tga files
+//
+//   imageutils resize  [options] [-w width] [-h height] [-f filter] [-m megabytes] [-l] input...
+//   imageutils blur    [options] -r radius input...
+//   imageutils convert [options] input...
+//
+//   options: [-o directory] [-t ppm|pam|tga] [-j workers] [--cpu level] [-q]
+//
+//an input is a file or a directory, of which all .ppm, .pam and .tga files are taken. the results
+//go into the output directory (default the current one) with the same name, the extension of -t
+//(default the format of the input). a result that would overwrite an input is skipped. -j is the
+//number of threads that work on the files, a file at a time per thread with the parts of every
+//file spread over the idle threads as well (default one per core). "-" as input reads one
+//picture from stdin and writes it to stdout.
+//
+//resize streams the files through ImageResize::resampleStrips with -m megabytes of buffers per
+//file (default 64), a missing width or height keeps the aspect ratio. -l resizes in linear light
+//with ImageResize::resampleLinear, on the whole picture in memory. blur loads the whole
+//picture and runs Stackblur::blurParallel, radii above Stackblur::MaxRadius go to the
+//approximation of Stackblur::blurLarge. both clear alpha, so their results have 3 channels.
+//convert copies the rows and keeps the channels of the input where the format allows. at the
+//end the throughput over all files is printed as megapixels of input per second
+
+#include "ImageResize.h"
+#include "stackblur.h"
+#include "threadpool.h"
+#include "imagefile.h"
+#include "image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctype.h>
+#include <mutex>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+   #define WIN32_LEAN_AND_MEAN
+   #define NOMINMAX
+   #include <windows.h>
+   #include <fcntl.h>
+   #include <io.h>
+#else
+   #include <dirent.h>
+   #include <sys/stat.h>
+#endif
+
+enum Operation {
+   OperationResize,
+   OperationBlur,
+   OperationConvert
+};
+
+struct Options {
+   Operation operation = OperationConvert;
+   const char *outputDirectory = ".";
+   bool sameFormat = true;
+   ImageFileFormat format = ImageFilePPM;
+   int width = 0;
+   int height = 0;
+   ResizeFilter filter = ResizeFilterLanczos3;
+   size_t memoryBudget = ImageResize::DefaultStripBudget;
+   bool linear = false;
+   int radius = 0;
+   bool quiet = false;
+};
+static Options gOptions;
+
+static std::mutex gPrintMutex;
+
+//=== files
+
+static bool isDirectory(const char *path) {
+#ifdef _WIN32
+   DWORD attributes = GetFileAttributesA(path);
+   return (attributes != INVALID_FILE_ATTRIBUTES) && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+   struct stat info;
+   return (stat(path, &info) == 0) && S_ISDIR(info.st_mode);
+#endif
+}
+
+static bool makeDirectory(const char *path) {
+   if(isDirectory(path))
+      return true;
+#ifdef _WIN32
+   return CreateDirectoryA(path, nullptr) != 0;
+#else
+   return mkdir(path, 0755) == 0;
+#endif
+}
+
+//the same for every path of a file, so an output can be told apart from the inputs: device and
+//inode of a file that exists, else the full path of its directory and its name
+static std::string fileKey(const std::string &path) {
+#ifdef _WIN32
+   char full[MAX_PATH];
+   if(!_fullpath(full, path.c_str(), MAX_PATH))
+      return path;
+   std::string key = full;
+   for(char &c : key)
+      c = (char)tolower((unsigned char)c);
+   return key;
+#else
+   struct stat info;
+   if(stat(path.c_str(), &info) == 0)
+      return "#" + std::to_string((unsigned long long)info.st_dev) + ":" + std::to_string((unsigned long long)info.st_ino);
+   size_t nameBegin = path.find_last_of('/');
+   std::string directory = (nameBegin == std::string::npos) ? "." : path.substr(0, nameBegin+1);
+   std::string name = (nameBegin == std::string::npos) ? path : path.substr(nameBegin+1);
+   char *full = realpath(directory.c_str(), nullptr);
+   if(!full)
+      return path;
+   std::string key = std::string(full) + "/" + name;
+   free(full);
+   return key;
+#endif
+}
+
+//the ppm, pam and tga files in a directory, sorted by name
+static void listDirectory(const std::string &directory, std::vector<std::string> &files) {
+   std::vector<std::string> names;
+#ifdef _WIN32
+   WIN32_FIND_DATAA data;
+   HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+   if(find == INVALID_HANDLE_VALUE)
+      return;
+   do {
+      if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+         names.push_back(data.cFileName);
+   } while(FindNextFileA(find, &data));
+   FindClose(find);
+#else
+   DIR *dir = opendir(directory.c_str());
+   if(!dir)
+      return;
+   while(struct dirent *entry = readdir(dir))
+      names.push_back(entry->d_name);
+   closedir(dir);
+#endif
+   std::sort(names.begin(), names.end());
+   for(const std::string &name : names) {
+      ImageFileFormat format;
+      std::string path = directory + "/" + name;
+      if(ImageFileLayout::formatFromPath(name.c_str(), format) && (format != ImageFileRaw) && !isDirectory(path.c_str()))
+         files.push_back(path);
+   }
+}
+
+//the output directory, the name of the input and the extension of the output format
+static std::string outputPath(const std::string &input, ImageFileFormat format) {
+   size_t nameBegin = input.find_last_of("/\\");
+   nameBegin = (nameBegin == std::string::npos) ? 0 : nameBegin+1;
+   size_t nameEnd = input.find_last_of('.');
+   if((nameEnd == std::string::npos) || (nameEnd < nameBegin))
+      nameEnd = input.size();
+   return std::string(gOptions.outputDirectory) + "/" + input.substr(nameBegin, nameEnd-nameBegin) +
+          ImageFileLayout::getExtension(format);
+}
+
+//=== operations
+
+//a missing side of the resize keeps the aspect ratio of the input
+static void outputSize(int inputWidth, int inputHeight, int &width, int &height) {
+   width = gOptions.width;
+   height = gOptions.height;
+   if(width <= 0)
+      width = (int)(((int64_t)inputWidth*height + inputHeight/2) / inputHeight);
+   if(height <= 0)
+      height = (int)(((int64_t)inputHeight*width + inputWidth/2) / inputWidth);
+   width = std::max(width, 1);
+   height = std::max(height, 1);
+}
+
+//the operation on a picture in memory, for blur, linear light and pictures from stdin
+static void process(Executor &executor, Image &image) {
+   if(gOptions.operation == OperationResize) {
+      int width, height;
+      outputSize(image.view().width, image.view().height, width, height);
+      Image output(width, height);
+      if(gOptions.linear) {
+         ImageResize::resampleLinear(executor, gOptions.filter, image.view(), output.view());
+      } else {
+         ViewRows source(image.view());
+         ViewRows sink(output.view());
+         ImageResize::resampleStrips(executor, gOptions.filter, source, sink, gOptions.memoryBudget);
+      }
+      image = std::move(output);
+   } else if(gOptions.operation == OperationBlur) {
+      //blurParallel() would clamp the radius
+      if(gOptions.radius > Stackblur::MaxRadius)
+         Stackblur::blurLarge(image.view(), gOptions.radius, gOptions.radius);
+      else
+         Stackblur::blurParallel(executor, image.view(), gOptions.radius, gOptions.radius);
+   }
+}
+
+static bool processFile(Executor &executor, const std::string &input, int64_t &pixels) {
+   MappedImage source;
+   if(!source.open(input.c_str())) {
+      fprintf(stderr, "can't read %s\n", input.c_str());
+      return false;
+   }
+   ImageFileFormat format = gOptions.sameFormat ? source.getFormat() : gOptions.format;
+   std::string output = outputPath(input, format);
+   if(fileKey(output) == fileKey(input)) {
+      fprintf(stderr, "%s would be overwritten, choose another output directory or format\n", input.c_str());
+      return false;
+   }
+   int inputWidth = source.getWidth();
+   int inputHeight = source.getHeight();
+   pixels = (int64_t)inputWidth*inputHeight;
+   //resize and blur clear alpha
+   int channels = (gOptions.operation == OperationConvert) ? source.getChannels() : 3;
+
+   bool written = false;
+   int width = inputWidth;
+   int height = inputHeight;
+   if((gOptions.operation == OperationBlur) || ((gOptions.operation == OperationResize) && gOptions.linear)) {
+      Image image;
+      written = MappedImage::load(input.c_str(), image);
+      source.close();
+      if(written) {
+         process(executor, image);
+         width = image.view().width;
+         height = image.view().height;
+         written = MappedImage::save(output.c_str(), image.view(), channels);
+      }
+   } else {
+      //resize and convert go from file to file row by row
+      if(gOptions.operation == OperationResize)
+         outputSize(inputWidth, inputHeight, width, height);
+      MappedImage sink;
+      written = sink.create(output.c_str(), format, width, height, channels);
+      if(written && (gOptions.operation == OperationResize)) {
+         ImageResize::resampleStrips(executor, gOptions.filter, source, sink, gOptions.memoryBudget);
+      } else if(written) {
+         std::vector<uint32_t> buffer(width);
+         for(int y=0; y<height; ++y) {
+            uint32_t *row = sink.beginRow(y, buffer.data());
+            const uint32_t *src = source.readRow(y, row);
+            if(src != row)
+               memcpy(row, src, (size_t)width*4);
+            sink.endRow(y, row);
+         }
+      }
+   }
+   if(!written) {
+      fprintf(stderr, "can't write %s\n", output.c_str());
+      return false;
+   }
+   if(!gOptions.quiet) {
+      std::lock_guard<std::mutex> lock(gPrintMutex);
+      printf("%s %dx%d -> %s %dx%d\n", input.c_str(), inputWidth, inputHeight, output.c_str(),
+             width, height);
+      fflush(stdout);
+   }
+   return true;
+}
+
+//one picture from stdin to stdout through ImageReader and ImageWriter
+static int processStream(Executor &executor) {
+#ifdef _WIN32
+   _setmode(_fileno(stdin), _O_BINARY);
+   _setmode(_fileno(stdout), _O_BINARY);
+#endif
+   ImageReader reader;
+   Image image;
+   if(!reader.open(stdin) || !reader.read(image)) {
+      fprintf(stderr, "can't read a picture from stdin\n");
+      return 1;
+   }
+   process(executor, image);
+   ImageFileLayout input = reader.getLayout();
+   int channels = (gOptions.operation == OperationConvert) ? input.channels : 3;
+   ImageFileLayout layout = ImageFileLayout::make(gOptions.sameFormat ? input.format : gOptions.format,
+                                                  image.view().width, image.view().height, channels);
+   ImageWriter writer;
+   if(!writer.open(stdout, layout) || !writer.write(image.view()) || (fflush(stdout) != 0)) {
+      fprintf(stderr, "can't write the picture to stdout\n");
+      return 1;
+   }
+   return 0;
+}
+
+//=== main
+
+static int usage(const char *name) {
+   fprintf(stderr, "usage: %s resize  [options] [-w width] [-h height] [-f filter] [-m megabytes] [-l] input...\n"
+                   "       %s blur    [options] -r radius input...\n"
+                   "       %s convert [options] input...\n"
+                   "options: [-o directory] [-t ppm|pam|tga] [-j workers] [--cpu level] [-q]\n"
+                   "an input is a .ppm, .pam or .tga file, a directory of them or - for stdin to stdout\n"
+                   "blur radii above %d are approximated\n",
+                   name, name, name, (int)Stackblur::MaxRadius);
+   return 1;
+}
+
+int main(int argc, char **argv) {
+   if(argc < 2)
+      return usage(argv[0]);
+   if(!strcmp(argv[1], "resize"))
+      gOptions.operation = OperationResize;
+   else if(!strcmp(argv[1], "blur"))
+      gOptions.operation = OperationBlur;
+   else if(!strcmp(argv[1], "convert"))
+      gOptions.operation = OperationConvert;
+   else
+      return usage(argv[0]);
+
+   int workers = 0;
+   std::vector<std::string> inputs;
+   for(int i=2; i<argc; ++i) {
+      bool hasValue = (i+1 < argc);
+      if(!strcmp(argv[i], "-o") && hasValue)
+         gOptions.outputDirectory = argv[++i];
+      else if(!strcmp(argv[i], "-t") && hasValue) {
+         std::string name = std::string("x.") + argv[++i];
+         if(!ImageFileLayout::formatFromPath(name.c_str(), gOptions.format) || (gOptions.format == ImageFileRaw)) {
+            fprintf(stderr, "unknown format %s\n", argv[i]);
+            return 1;
+         }
+         gOptions.sameFormat = false;
+      } else if(!strcmp(argv[i], "-j") && hasValue)
+         workers = atoi(argv[++i]);
+      else if(!strcmp(argv[i], "-w") && hasValue)
+         gOptions.width = atoi(argv[++i]);
+      else if(!strcmp(argv[i], "-h") && hasValue)
+         gOptions.height = atoi(argv[++i]);
+      else if(!strcmp(argv[i], "-f") && hasValue) {
+         if(!ImageResize::parseFilter(argv[++i], gOptions.filter)) {
+            fprintf(stderr, "unknown filter %s\n", argv[i]);
+            return 1;
+         }
+      } else if(!strcmp(argv[i], "-m") && hasValue)
+         gOptions.memoryBudget = (size_t)atoi(argv[++i]) << 20;
+      else if(!strcmp(argv[i], "-l"))
+         gOptions.linear = true;
+      else if(!strcmp(argv[i], "-r") && hasValue)
+         gOptions.radius = atoi(argv[++i]);
+      else if(!strcmp(argv[i], "--cpu") && hasValue) {
+         CpuLevel level;
+         if(!CpuFeatures::parseLevel(argv[++i], level)) {
+            fprintf(stderr, "unknown cpu level %s\n", argv[i]);
+            return 1;
+         }
+         CpuFeatures::setLevel(level);
+      } else if(!strcmp(argv[i], "-q"))
+         gOptions.quiet = true;
+      else if(!strcmp(argv[i], "-") || (argv[i][0] != '-'))
+         inputs.push_back(argv[i]);
+      else
+         return usage(argv[0]);
+   }
+   if(inputs.empty() || ((gOptions.operation == OperationResize) && (gOptions.width <= 0) && (gOptions.height <= 0)) ||
+      ((gOptions.operation == OperationBlur) && (gOptions.radius <= 0)))
+      return usage(argv[0]);
+
+   ThreadPool pool(workers);
+   if((inputs.size() == 1) && (inputs[0] == "-"))
+      return processStream(pool);
+
+   std::vector<std::string> files;
+   for(const std::string &input : inputs) {
+      if(isDirectory(input.c_str()))
+         listDirectory(input, files);
+      else
+         files.push_back(input);
+   }
+   if(!makeDirectory(gOptions.outputDirectory)) {
+      fprintf(stderr, "can't create %s\n", gOptions.outputDirectory);
+      return 1;
+   }
+   //an output must not be one of the inputs, they are still mapped while it is written, and two
+   //inputs that differ only in the extension would end up in the same file
+   std::set<std::string> inputKeys;
+   for(const std::string &file : files)
+      inputKeys.insert(fileKey(file));
+   std::set<std::string> outputs;
+   int failures = 0;
+   for(size_t i=0; i<files.size(); ) {
+      ImageFileFormat format = gOptions.format;
+      if(gOptions.sameFormat)
+         ImageFileLayout::formatFromPath(files[i].c_str(), format);
+      std::string output = outputPath(files[i], format);
+      std::string key = fileKey(output);
+      if(inputKeys.count(key)) {
+         fprintf(stderr, "%s is skipped, %s is an input, choose another output directory or format\n",
+                 files[i].c_str(), output.c_str());
+      } else if(!outputs.insert(key).second) {
+         fprintf(stderr, "%s is skipped, %s is written already\n", files[i].c_str(), output.c_str());
+      } else {
+         i++;
+         continue;
+      }
+      files.erase(files.begin()+i);
+      failures++;
+   }
+
+   //every file is a job, the bands of a file are jobs of the same pool
+   std::atomic<int> failed(failures);
+   std::atomic<int64_t> pixels(0);
+   auto start = std::chrono::steady_clock::now();
+   pool.run((int)files.size(), [&](int i) {
+      int64_t filePixels = 0;
+      if(processFile(pool, files[i], filePixels))
+         pixels += filePixels;
+      else
+         failed++;
+   });
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   double megapixels = (double)pixels.load() / 1e6;
+   printf("%d files, %d failed, %.1f MP in %.3f s, %.2f MP/s with %d threads at cpu level %s\n",
+          (int)files.size()+failures, failed.load(), megapixels, seconds, (seconds > 0) ? megapixels/seconds : 0.0,
+          pool.getNumberThreads(), CpuFeatures::getLevelName(CpuFeatures::getLevel()));
+   return (failed.load() == 0) ? 0 : 1;
+}